@@ -0,0 +1,114 @@
+#include "arena.h"
+#include "common.h"
+#include <stdlib.h>
+
+struct ArenaChunk {
+    ArenaChunk *prev;
+    ArenaChunk *next;
+    // Keep the payload aligned to 16 bytes.
+    size_t pad[2];
+};
+
+// Classes 0...63 are multiples of 16 up to 1024 bytes; classes 64...69 are powers of two from 2048
+// up to ARENA_MAX_SMALL bytes.
+static inline unsigned size_class(size_t n)
+{
+    if (n <= 1024)
+        return n ? (n - 1) / 16 : 0;
+    unsigned c = 64;
+    for (size_t sz = 2048; sz < n; sz *= 2)
+        ++c;
+    return c;
+}
+
+static inline size_t class_size(unsigned c)
+{
+    if (c < 64)
+        return (c + 1) * 16;
+    return ((size_t) 2048) << (c - 64);
+}
+
+static void link_chunk(ArenaChunk **head, ArenaChunk *ch)
+{
+    ch->prev = NULL;
+    ch->next = *head;
+    if (*head)
+        (*head)->prev = ch;
+    *head = ch;
+}
+
+void *arena_alloc(Arena *a, size_t n)
+{
+    if (n > ARENA_MAX_SMALL) {
+        if (n > SIZE_MAX - sizeof(ArenaChunk)) {
+            die_out_of_memory();
+        }
+        ArenaChunk *ch = malloc_or_die(sizeof(ArenaChunk) + n, 1);
+        ++a->nmallocs;
+        a->nbytes += n;
+        link_chunk(&a->large, ch);
+        return ch + 1;
+    }
+
+    unsigned c = size_class(n);
+    size_t sz = class_size(c);
+    a->nbytes += sz;
+
+    void *p = a->free_lists[c];
+    if (p) {
+        a->free_lists[c] = *(void **) p;
+        return p;
+    }
+
+    if (a->ncur < sz) {
+        // The tail of the current chunk is lost until the next reset.
+        ArenaChunk *ch = malloc_or_die(sizeof(ArenaChunk) + ARENA_CHUNK_SIZE, 1);
+        ++a->nmallocs;
+        link_chunk(&a->chunks, ch);
+        a->cur = (char *) (ch + 1);
+        a->ncur = ARENA_CHUNK_SIZE;
+    }
+    p = a->cur;
+    a->cur += sz;
+    a->ncur -= sz;
+    return p;
+}
+
+void arena_free(Arena *a, void *p, size_t n)
+{
+    if (n > ARENA_MAX_SMALL) {
+        ArenaChunk *ch = ((ArenaChunk *) p) - 1;
+        if (ch->prev) {
+            ch->prev->next = ch->next;
+        } else {
+            a->large = ch->next;
+        }
+        if (ch->next)
+            ch->next->prev = ch->prev;
+        free(ch);
+        a->nbytes -= n;
+        return;
+    }
+
+    unsigned c = size_class(n);
+    a->nbytes -= class_size(c);
+    *(void **) p = a->free_lists[c];
+    a->free_lists[c] = p;
+}
+
+static void free_chunks(ArenaChunk *ch)
+{
+    while (ch) {
+        ArenaChunk *next = ch->next;
+        free(ch);
+        ch = next;
+    }
+}
+
+void arena_reset(Arena *a)
+{
+    free_chunks(a->chunks);
+    free_chunks(a->large);
+    uint64_t nmallocs = a->nmallocs;
+    *a = (Arena) {.nmallocs = nmallocs};
+}
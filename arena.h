@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// A slab allocator for many small objects that are often freed all at once. Small blocks are carved
+// out of large chunks and recycled through per-size-class free lists; blocks larger than
+// ARENA_MAX_SMALL bytes are allocated separately. The caller passes the size of a block to
+// 'arena_free()'.
+
+enum {
+    ARENA_CHUNK_SIZE = 1024 * 1024,
+    ARENA_MAX_SMALL = 64 * 1024,
+    ARENA_NCLASSES = 70,
+};
+
+typedef struct ArenaChunk ArenaChunk;
+
+typedef struct {
+    // Chunks and large blocks; both are freed by 'arena_reset()'.
+    ArenaChunk *chunks;
+    ArenaChunk *large;
+
+    // Free space at the end of the current chunk.
+    char *cur;
+    size_t ncur;
+
+    void *free_lists[ARENA_NCLASSES];
+
+    // Number of malloc() calls made on behalf of this arena.
+    uint64_t nmallocs;
+    // Number of bytes currently handed out (rounded up to size classes).
+    size_t nbytes;
+} Arena;
+
+// Never returns NULL; returned blocks are aligned to 16 bytes.
+void *arena_alloc(Arena *a, size_t n);
+
+// 'n' must be the size 'p' was allocated with.
+void arena_free(Arena *a, void *p, size_t n);
+
+// Frees all the blocks at once; the arena can be used again afterwards.
+void arena_reset(Arena *a);
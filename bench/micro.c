@@ -0,0 +1,421 @@
+// Microbenchmarks of the hot paths of cmenu. Prints one JSON object per line:
+//
+//   {"bench": "micro", "name": NAME, "ops": N, "ns_per_op": T, "mb_per_s": R}
+//
+// where 'mb_per_s' is only given for the benchmarks that consume input bytes. Each benchmark is
+// repeated until it has run for at least MIN_NS nanoseconds, and the best of NRUNS such runs is
+// reported.
+
+#include "bio.h"
+#include "common.h"
+#include "decode.h"
+#include "itree.h"
+#include "parse_uint.h"
+#include "print_uint.h"
+#include "trigram.h"
+#include "truncated_text.h"
+#include "utf8.h"
+
+#include <locale.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+enum {
+    NRUNS = 3,
+    MIN_NS = 200 * 1000 * 1000,
+};
+
+static int64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((int64_t) ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+// Keeps the compiler from optimizing the benchmarked calls away.
+static volatile uint64_t sink;
+
+// A benchmark runs its operation 'n' times over 'arg' and returns the number of input bytes it has
+// consumed (or 0).
+typedef uint64_t (*BenchFunc)(void *arg, uint64_t n);
+
+static void run(const char *name, BenchFunc f, void *arg)
+{
+    double best = 0;
+    uint64_t best_ops = 0;
+    uint64_t best_bytes = 0;
+    for (int r = 0; r < NRUNS; ++r) {
+        uint64_t n = 1;
+        for (;;) {
+            int64_t t = now_ns();
+            uint64_t nbytes = f(arg, n);
+            int64_t elapsed = now_ns() - t;
+            if (elapsed >= MIN_NS) {
+                double per_op = (double) elapsed / n;
+                if (!best_ops || per_op < best) {
+                    best = per_op;
+                    best_ops = n;
+                    best_bytes = nbytes;
+                }
+                break;
+            }
+            n *= 2;
+        }
+    }
+    printf("{\"bench\": \"micro\", \"name\": \"%s\", \"ops\": %llu, \"ns_per_op\": %.2f",
+           name, (unsigned long long) best_ops, best);
+    if (best_bytes) {
+        double seconds = best * best_ops / 1e9;
+        printf(", \"mb_per_s\": %.1f", best_bytes / seconds / 1e6);
+    }
+    printf("}\n");
+    fflush(stdout);
+}
+
+// bio_read_line: reads the lines of a file of short lines over and over; one op is one line.
+
+static uint64_t bench_bio_read_line(void *arg, uint64_t n)
+{
+    int fd = fileno((FILE *) arg);
+    uint64_t nbytes = 0;
+    Bio bio = {.fd = fd};
+    int caught_signal = 0;
+    for (uint64_t i = 0; i < n; ++i) {
+        char *line;
+        ssize_t r = bio_read_line(&bio, &line, &caught_signal);
+        if (r <= 0) {
+            lseek(fd, 0, SEEK_SET);
+            bio_reset(&bio);
+            bio.fd = fd;
+            r = bio_read_line(&bio, &line, &caught_signal);
+        }
+        nbytes += r;
+    }
+    bio_reset(&bio);
+    return nbytes;
+}
+
+// itree_remove + itree_insert: moves a node from a random position to another one in a tree of a
+// given size; one op is one removal and one insertion. The cost should grow with log(size) only.
+
+typedef struct {
+    ITree tree;
+    uint64_t x;
+} TreeArg;
+
+static uint64_t xorshift64(uint64_t *x)
+{
+    *x ^= *x << 13;
+    *x ^= *x >> 7;
+    *x ^= *x << 17;
+    return *x;
+}
+
+static uint64_t bench_itree_move(void *varg, uint64_t n)
+{
+    TreeArg *arg = varg;
+    size_t size = itree_size(&arg->tree);
+    for (uint64_t i = 0; i < n; ++i) {
+        ITreeNode *node = itree_remove(&arg->tree, xorshift64(&arg->x) % size);
+        itree_insert(&arg->tree, xorshift64(&arg->x) % size, node);
+    }
+    sink += itree_size(&arg->tree);
+    return 0;
+}
+
+// trigram_index_*: the cost of keeping the index up to date, and of an indexed filter query, in an
+// index of a given size. An update op replaces an item with a new one (which is what a '=' command
+// does with '-index=trigram'). A query op looks the query up and shows exactly the candidates in a
+// list of that size, as 'list_filter_from_index()' does (without checking the candidates against the
+// query); its cost should depend on the number of candidates, not on the size of the list.
+
+typedef struct {
+    TrigramIndex index;
+    uint32_t *ids;
+    ITree tree;
+    ITreeNode *nodes;
+    size_t size;
+    const char *query;
+    uint64_t next;
+} IndexArg;
+
+static const char *index_words[] = {
+    "alpha", "bravo", "charlie", "delta", "echo", "foxtrot", "golf", "hotel",
+};
+
+// The first 64 items, and only them, have the word "zulu".
+static void index_text(char *buf, size_t nbuf, uint64_t i)
+{
+    snprintf(buf, nbuf, "entry %llu %s %s /var/lib/item-%llx",
+             (unsigned long long) i, index_words[i % 8], i < 64 ? "zulu" : index_words[i / 8 % 8],
+             (unsigned long long) i * 2654435761u);
+}
+
+static void index_add(IndexArg *arg, size_t slot, uint64_t i)
+{
+    char buf[128];
+    index_text(buf, sizeof(buf), i);
+    trigram_index_feed(&arg->index, buf, strlen(buf));
+    arg->ids[slot] = trigram_index_commit(&arg->index, &arg->nodes[slot]);
+}
+
+static uint64_t bench_trigram_update(void *varg, uint64_t n)
+{
+    IndexArg *arg = varg;
+    for (uint64_t i = 0; i < n; ++i) {
+        size_t slot = arg->next % arg->size;
+        trigram_index_remove(&arg->index, arg->ids[slot]);
+        index_add(arg, slot, arg->size + arg->next++);
+    }
+    return 0;
+}
+
+static uint64_t bench_trigram_query(void *varg, uint64_t n)
+{
+    IndexArg *arg = varg;
+    size_t nquery = strlen(arg->query);
+    for (uint64_t i = 0; i < n; ++i) {
+        void **items;
+        size_t nitems;
+        trigram_index_lookup(&arg->index, arg->query, nquery, &items, &nitems);
+        itree_set_all_visible(&arg->tree, false);
+        for (size_t j = 0; j < nitems; ++j) {
+            itree_set_visible(items[j], true);
+        }
+        sink += itree_nvisible(&arg->tree);
+    }
+    return 0;
+}
+
+// decode_copy, truncate_text_to_width: over a set of cells.
+
+typedef struct {
+    const char **cells;
+    size_t ncells;
+} CellsArg;
+
+static uint64_t bench_decode_copy(void *varg, uint64_t n)
+{
+    CellsArg *arg = varg;
+    uint64_t nbytes = 0;
+    for (uint64_t i = 0; i < n; ++i) {
+        const char *s = arg->cells[i % arg->ncells];
+        size_t ns = strlen(s);
+        wchar_t *w = decode_copy(s, ns);
+        sink += w[0];
+        free(w);
+        nbytes += ns;
+    }
+    return nbytes;
+}
+
+// utf8_wcwidth, wcwidth: over the code points of a set of cells; one op is one code point.
+
+typedef struct {
+    wchar_t *chars;
+    size_t nchars;
+} CharsArg;
+
+static uint64_t bench_utf8_wcwidth(void *varg, uint64_t n)
+{
+    CharsArg *arg = varg;
+    for (uint64_t i = 0; i < n; ++i) {
+        sink += utf8_wcwidth(arg->chars[i % arg->nchars]);
+    }
+    return 0;
+}
+
+static uint64_t bench_libc_wcwidth(void *varg, uint64_t n)
+{
+    CharsArg *arg = varg;
+    for (uint64_t i = 0; i < n; ++i) {
+        sink += wcwidth(arg->chars[i % arg->nchars]);
+    }
+    return 0;
+}
+
+typedef struct {
+    TruncatedText *texts;
+    size_t ntexts;
+} TextsArg;
+
+static uint64_t bench_truncate_text_to_width(void *varg, uint64_t n)
+{
+    TextsArg *arg = varg;
+    for (uint64_t i = 0; i < n; ++i) {
+        TruncatedText *t = &arg->texts[i % arg->ntexts];
+        // Forget the last result, which would otherwise be returned right away.
+        t->target_width = 0;
+        truncate_text_to_width(t, 1 + i % 40);
+        sink += t->truncated_n;
+    }
+    return 0;
+}
+
+// parse_uint, print_uint: over a set of numbers of various lengths.
+
+enum {
+    NNUMBERS = 1024,
+};
+
+static char number_texts[NNUMBERS][24];
+static uint64_t numbers[NNUMBERS];
+
+static uint64_t bench_parse_uint(void *varg, uint64_t n)
+{
+    (void) varg;
+    uint64_t nbytes = 0;
+    for (uint64_t i = 0; i < n; ++i) {
+        const char *s = number_texts[i % NNUMBERS];
+        size_t ns = strlen(s);
+        sink += parse_uint(s, ns, INT64_MAX);
+        nbytes += ns;
+    }
+    return nbytes;
+}
+
+static uint64_t bench_print_uint(void *varg, uint64_t n)
+{
+    (void) varg;
+    char buf[24];
+    for (uint64_t i = 0; i < n; ++i) {
+        sink += print_uint(buf, numbers[i % NNUMBERS]);
+    }
+    return 0;
+}
+
+static const char *mixed_cells[] = {
+    "/org/freedesktop/NetworkManager/Devices/3",
+    "Привет, мир! Это строка с кириллицей.",
+    "日本語のテキストとひらがな、カタカナ。",
+    "emoji 😀🎉🚀 and accents: café, naïve, über",
+    "plain ascii cell of moderate length, like a file name.txt",
+};
+
+int main(void)
+{
+    setlocale(LC_ALL, "C.UTF-8");
+    utf8_init();
+
+    // bio_read_line.
+    FILE *lines = tmpfile();
+    if (!lines) {
+        perror("tmpfile");
+        return 1;
+    }
+    for (int i = 0; i < 1000000; ++i) {
+        fprintf(lines, "entry number %d\n", i);
+    }
+    fflush(lines);
+    run("bio_read_line", bench_bio_read_line, lines);
+    fclose(lines);
+
+    // itree_remove + itree_insert.
+    static const size_t tree_sizes[] = {1000, 100000, 1000000};
+    for (size_t i = 0; i < sizeof(tree_sizes) / sizeof(tree_sizes[0]); ++i) {
+        size_t size = tree_sizes[i];
+        ITreeNode *nodes = malloc_or_die(size, sizeof(ITreeNode));
+        TreeArg tree_arg = {.tree = {.seed = 1}, .x = 88172645463325252u};
+        for (size_t j = 0; j < size; ++j) {
+            itree_insert(&tree_arg.tree, j, &nodes[j]);
+        }
+        char name[64];
+        snprintf(name, sizeof(name), "itree_move/%zu", size);
+        run(name, bench_itree_move, &tree_arg);
+        free(nodes);
+    }
+
+    // trigram_index_*.
+    static const size_t index_sizes[] = {100000, 1000000};
+    for (size_t i = 0; i < sizeof(index_sizes) / sizeof(index_sizes[0]); ++i) {
+        size_t size = index_sizes[i];
+        IndexArg index_arg = {
+            .ids = malloc_or_die(size, sizeof(uint32_t)),
+            .tree = {.seed = 1},
+            .nodes = malloc_or_die(size, sizeof(ITreeNode)),
+            .size = size,
+        };
+        for (size_t j = 0; j < size; ++j) {
+            itree_insert(&index_arg.tree, j, &index_arg.nodes[j]);
+            index_add(&index_arg, j, j);
+        }
+        // A query with 64 candidates, and one with an eighth of the items.
+        char name[64];
+        index_arg.query = "zulu";
+        snprintf(name, sizeof(name), "trigram_query/rare/%zu", size);
+        run(name, bench_trigram_query, &index_arg);
+        index_arg.query = "hotel hotel";
+        snprintf(name, sizeof(name), "trigram_query/common/%zu", size);
+        run(name, bench_trigram_query, &index_arg);
+        snprintf(name, sizeof(name), "trigram_update/%zu", size);
+        run(name, bench_trigram_update, &index_arg);
+        trigram_index_clear(&index_arg.index);
+        free(index_arg.ids);
+        free(index_arg.nodes);
+    }
+
+    // decode_copy.
+    const char *ascii_cells[] = {
+        "plain ascii cell of moderate length, like a file name.txt",
+        "another one",
+        "x",
+        "/dev/disk/by-uuid/0123456789abcdef",
+    };
+    CellsArg ascii = {ascii_cells, sizeof(ascii_cells) / sizeof(ascii_cells[0])};
+    CellsArg mixed = {mixed_cells, sizeof(mixed_cells) / sizeof(mixed_cells[0])};
+    run("decode_copy/ascii", bench_decode_copy, &ascii);
+    run("decode_copy/mixed", bench_decode_copy, &mixed);
+    // The same through mbsnrtowcs(), which is used in other locales.
+    utf8_enabled = false;
+    run("decode_copy/ascii/libc", bench_decode_copy, &ascii);
+    run("decode_copy/mixed/libc", bench_decode_copy, &mixed);
+    utf8_enabled = true;
+
+    // utf8_wcwidth, wcwidth.
+    CharsArg chars = {NULL, 0};
+    size_t nchars_buf = 0;
+    for (size_t i = 0; i < mixed.ncells; ++i) {
+        const char *cell = mixed_cells[i];
+        chars.nchars += decode_append(cell, strlen(cell), &chars.chars, &nchars_buf, chars.nchars);
+    }
+    run("wcwidth/table", bench_utf8_wcwidth, &chars);
+    run("wcwidth/libc", bench_libc_wcwidth, &chars);
+    free(chars.chars);
+
+    // truncate_text_to_width.
+    TruncatedText texts[sizeof(mixed_cells) / sizeof(mixed_cells[0])];
+    TextsArg targ = {texts, sizeof(texts) / sizeof(texts[0])};
+    for (size_t i = 0; i < targ.ntexts; ++i) {
+        wchar_t *w = decode_copy(mixed_cells[i], strlen(mixed_cells[i]));
+        size_t nw = wcslen(w);
+        uint32_t *widths = malloc_or_die(nw ? nw : 1, sizeof(uint32_t));
+        texts[i] = (TruncatedText) {.s = w, .n = nw};
+        if (!truncated_text_prepare(&texts[i], widths)) {
+            texts[i].widths = widths;
+        }
+    }
+    run("truncate_text_to_width", bench_truncate_text_to_width, &targ);
+
+    // parse_uint, print_uint.
+    uint64_t x = 88172645463325252u;
+    for (size_t i = 0; i < NNUMBERS; ++i) {
+        // xorshift64, with a random number of decimal digits.
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        uint64_t v = x >> 1;
+        for (size_t j = x % 19; j; --j) {
+            v /= 10;
+        }
+        numbers[i] = v;
+        snprintf(number_texts[i], sizeof(number_texts[i]), "%llu", (unsigned long long) v);
+    }
+    run("parse_uint", bench_parse_uint, NULL);
+    run("print_uint", bench_print_uint, NULL);
+
+    return 0;
+}
@@ -0,0 +1,345 @@
+#!/usr/bin/env python3
+# End-to-end benchmarks: runs cmenu on a pseudo-terminal, feeds it synthetic workloads through its
+# -infd=/-outfd= pipes and prints one JSON object per line:
+#
+#   {"bench": "pty", "workload": NAME, ...metrics..., "peak_rss_kb": N}
+#
+# Times are in microseconds unless the name says otherwise. Usage:
+#
+#   pty_bench.py CMENU [WORKLOAD...] [-scale=F]
+#
+# where -scale= multiplies the sizes of all the workloads (default: 1).
+import fcntl
+import json
+import os
+import pty
+import random
+import re
+import struct
+import sys
+import termios
+import threading
+import time
+
+
+ROWS, COLS = 40, 120
+
+
+class Terminal:
+    """cmenu running on a pseudo-terminal, with the output to the terminal drained (and counted) by
+    a background thread."""
+
+    def __init__(self, cmenu, args):
+        their_in, self.out_fd = os.pipe()
+        self.in_fd, their_out = os.pipe()
+        os.set_inheritable(their_in, True)
+        os.set_inheritable(their_out, True)
+
+        self.pid, self.master = pty.fork()
+        if self.pid == 0:
+            fcntl.ioctl(0, termios.TIOCSWINSZ, struct.pack('HHHH', ROWS, COLS, 0, 0))
+            os.environ.setdefault('TERM', 'xterm')
+            os.execv(cmenu, [cmenu, f'-infd={their_in}', f'-outfd={their_out}', *args])
+        os.close(their_in)
+        os.close(their_out)
+
+        self.lock = threading.Lock()
+        self.nbytes = 0
+        self.last_output = time.monotonic()
+        self.tail = b''
+        self.pending = b''
+        threading.Thread(target=self._drain, daemon=True).start()
+
+    def _drain(self):
+        while True:
+            try:
+                data = os.read(self.master, 65536)
+            except OSError:
+                return
+            if not data:
+                return
+            with self.lock:
+                self.nbytes += len(data)
+                self.last_output = time.monotonic()
+                self.tail = (self.tail + data)[-16384:]
+
+    def send(self, data):
+        view = memoryview(data)
+        while view:
+            n = os.write(self.out_fd, view)
+            view = view[n:]
+
+    def key(self, data):
+        os.write(self.master, data)
+
+    def read_reply(self, n):
+        while len(self.pending) < n:
+            data = os.read(self.in_fd, 65536)
+            if not data:
+                raise EOFError('cmenu has closed its output')
+            self.pending += data
+        reply, self.pending = self.pending[:n], self.pending[n:]
+        return reply
+
+    def read_line(self):
+        while b'\n' not in self.pending:
+            data = os.read(self.in_fd, 65536)
+            if not data:
+                raise EOFError('cmenu has closed its output')
+            self.pending += data
+        line, self.pending = self.pending.split(b'\n', 1)
+        return line.decode()
+
+    def terminal_bytes(self):
+        with self.lock:
+            return self.nbytes
+
+    def wait_quiet(self, quiet=0.2, limit=60):
+        """Waits until nothing has been written to the terminal for 'quiet' seconds (counting from
+        now at the earliest); returns the time of the last output."""
+        start = time.monotonic()
+        end = start + limit
+        while time.monotonic() < end:
+            with self.lock:
+                last = self.last_output
+            if time.monotonic() - max(last, start) >= quiet:
+                return last
+            time.sleep(quiet / 4)
+        return time.monotonic()
+
+    def frames(self):
+        """Returns the number of frames rendered so far, as shown by the <CTRL>+G tooltip."""
+        self.key(b'\x1b')
+        self.wait_quiet()
+        with self.lock:
+            self.tail = b''
+        self.key(b'\x07')
+        self.wait_quiet()
+        with self.lock:
+            text = re.sub(rb'\x1b\[[0-9;?]*[A-Za-z]|\x1b[()][A-Za-z0-9]|\x1b.', b'', self.tail)
+        self.key(b'\x1b')
+        # Let the escape key stand on its own rather than start a sequence with the next key.
+        self.wait_quiet()
+        m = re.search(rb'(\d+) frames for', text)
+        return int(m.group(1)) if m else None
+
+    def peak_rss_kb(self):
+        try:
+            with open(f'/proc/{self.pid}/status') as f:
+                for line in f:
+                    if line.startswith('VmHWM:'):
+                        return int(line.split()[1])
+        except OSError:
+            pass
+        return None
+
+    def quit(self):
+        self.key(b'q')
+        os.waitpid(self.pid, 0)
+        os.close(self.out_fd)
+        os.close(self.in_fd)
+
+
+def percentile(xs, p):
+    xs = sorted(xs)
+    return xs[min(len(xs) - 1, int(len(xs) * p / 100))] if xs else None
+
+
+def make_pack(commands):
+    return (f'n {len(commands)}\n' + ''.join(commands)).encode()
+
+
+def entry_lines(cells):
+    return ''.join(f'{cell}\n' for cell in cells)
+
+
+def ascii_cells(rnd, ncols):
+    return [f'entry {rnd.randrange(10**9)} {"x" * rnd.randrange(40)}' for _ in range(ncols)]
+
+
+WIDE_WORDS = ['日本語', 'テキスト', 'Привет', 'мир', '😀🎉', 'café', 'naïve', '한국어', 'ひらがな']
+
+
+def unicode_cells(rnd, ncols):
+    return [' '.join(rnd.choice(WIDE_WORDS) for _ in range(rnd.randrange(2, 12))) for _ in range(ncols)]
+
+
+def columns_args(ncols):
+    return [f'-column=:C{i}' for i in range(ncols)]
+
+
+def load(term, rnd, n, ncols, cells=ascii_cells):
+    term.send(make_pack(['+\n' + entry_lines(cells(rnd, ncols)) for _ in range(n)]))
+    assert term.read_line() == 'ok'
+
+
+def bench_bulk_load(cmenu, scale):
+    rnd = random.Random(1)
+    n = int(200000 * scale)
+    pack = make_pack(['+\n' + entry_lines(ascii_cells(rnd, 3)) for _ in range(n)])
+    term = Terminal(cmenu, columns_args(3))
+    t = time.monotonic()
+    term.send(pack)
+    assert term.read_line() == 'ok'
+    elapsed = time.monotonic() - t
+    result = {
+        'entries': n,
+        'seconds': round(elapsed, 4),
+        'entries_per_s': round(n / elapsed),
+        'mb_per_s': round(len(pack) / elapsed / 1e6, 1),
+        'peak_rss_kb': term.peak_rss_kb(),
+    }
+    term.quit()
+    return result
+
+
+def bench_churn(cmenu, scale):
+    rnd = random.Random(2)
+    size = int(100000 * scale)
+    npacks = int(2000 * scale)
+    term = Terminal(cmenu, columns_args(3))
+    load(term, rnd, size, 3)
+    latencies = []
+    t0 = time.monotonic()
+    for _ in range(npacks):
+        commands = []
+        for _ in range(8):
+            r = rnd.random()
+            if r < 0.6:
+                commands.append(f'= {rnd.randrange(size)}\n' + entry_lines(ascii_cells(rnd, 3)))
+            elif r < 0.8:
+                commands.append(f'- {rnd.randrange(size)}\n')
+                size -= 1
+            else:
+                commands.append(f'+ {rnd.randrange(size + 1)}\n' + entry_lines(ascii_cells(rnd, 3)))
+                size += 1
+        pack = make_pack(commands)
+        t = time.monotonic()
+        term.send(pack)
+        assert term.read_line() == 'ok'
+        latencies.append((time.monotonic() - t) * 1e6)
+    elapsed = time.monotonic() - t0
+    result = {
+        'packs': npacks,
+        'commands_per_pack': 8,
+        'packs_per_s': round(npacks / elapsed),
+        'pack_latency_p50_us': round(percentile(latencies, 50)),
+        'pack_latency_p99_us': round(percentile(latencies, 99)),
+        'peak_rss_kb': term.peak_rss_kb(),
+    }
+    term.quit()
+    return result
+
+
+def redraw_bench(cmenu, scale, ncols, cells):
+    """Changes all the visible entries once per frame and waits for each frame to be rendered."""
+    rnd = random.Random(3)
+    nframes = int(300 * scale)
+    term = Terminal(cmenu, ['-ack=after-render', '-ack-timing', *columns_args(ncols)])
+    term.send(make_pack(['+\n' + entry_lines(cells(rnd, ncols)) for _ in range(10000)]))
+    term.read_line()
+    term.wait_quiet()
+    renders = []
+    latencies = []
+    nbytes0 = term.terminal_bytes()
+    for _ in range(nframes):
+        pack = make_pack([f'== 0 {ROWS}\n' + ''.join(entry_lines(cells(rnd, ncols)) for _ in range(ROWS))])
+        t = time.monotonic()
+        term.send(pack)
+        _, parse_us, apply_us, render_us = term.read_line().split()
+        latencies.append((time.monotonic() - t) * 1e6)
+        renders.append(int(render_us))
+    term.wait_quiet()
+    nbytes = term.terminal_bytes() - nbytes0
+    result = {
+        'frames': nframes,
+        'columns': ncols,
+        'render_p50_us': percentile(renders, 50),
+        'render_p99_us': percentile(renders, 99),
+        'frame_latency_p50_us': round(percentile(latencies, 50)),
+        'bytes_per_frame': round(nbytes / nframes),
+        'peak_rss_kb': term.peak_rss_kb(),
+    }
+    term.quit()
+    return result
+
+
+def bench_redraw_ascii(cmenu, scale):
+    return redraw_bench(cmenu, scale, 3, ascii_cells)
+
+
+def bench_redraw_unicode(cmenu, scale):
+    return redraw_bench(cmenu, scale, 3, unicode_cells)
+
+
+def bench_redraw_columns(cmenu, scale):
+    return redraw_bench(cmenu, scale, 32, ascii_cells)
+
+
+def bench_keystrokes(cmenu, scale):
+    """Sends a burst of navigation keys and waits for the screen to settle."""
+    rnd = random.Random(4)
+    nkeys = int(2000 * scale)
+    term = Terminal(cmenu, columns_args(3))
+    load(term, rnd, int(100000 * scale), 3)
+    term.wait_quiet()
+    frames0 = term.frames()
+    term.wait_quiet()
+    nbytes0 = term.terminal_bytes()
+    keys = bytes(rnd.choice(b'jjjjk\x06\x02') for _ in range(nkeys))
+    t = time.monotonic()
+    for i in range(0, nkeys, 64):
+        term.key(keys[i:i + 64])
+    last = term.wait_quiet()
+    elapsed = last - t
+    nbytes = term.terminal_bytes() - nbytes0
+    frames1 = term.frames()
+    nframes = frames1 - frames0 if frames0 is not None and frames1 is not None else None
+    result = {
+        'keys': nkeys,
+        'keys_per_s': round(nkeys / elapsed),
+        'frames': nframes,
+        'bytes_per_frame': round(nbytes / nframes) if nframes else None,
+        'peak_rss_kb': term.peak_rss_kb(),
+    }
+    term.quit()
+    return result
+
+
+WORKLOADS = {
+    'bulk_load': bench_bulk_load,
+    'churn': bench_churn,
+    'redraw_ascii': bench_redraw_ascii,
+    'redraw_unicode': bench_redraw_unicode,
+    'redraw_columns': bench_redraw_columns,
+    'keystrokes': bench_keystrokes,
+}
+
+
+def main():
+    args = sys.argv[1:]
+    scale = 1.0
+    names = []
+    cmenu = None
+    for arg in args:
+        if arg.startswith('-scale='):
+            scale = float(arg[len('-scale='):])
+        elif cmenu is None:
+            cmenu = os.path.abspath(arg)
+        elif arg in WORKLOADS:
+            names.append(arg)
+        else:
+            print(f'Unknown workload: {arg}', file=sys.stderr)
+            sys.exit(2)
+    if cmenu is None:
+        print(f'USAGE: {sys.argv[0]} CMENU [WORKLOAD...] [-scale=F]', file=sys.stderr)
+        sys.exit(2)
+
+    for name in names or WORKLOADS:
+        result = {'bench': 'pty', 'workload': name}
+        result.update(WORKLOADS[name](cmenu, scale))
+        print(json.dumps(result), flush=True)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,195 @@
+// Differential check of the self-contained UTF-8 decoder and the generated width table (see utf8.c)
+// against mbrtowc() and wcwidth() of the C library, in a UTF-8 locale; the widths of whole strings
+// taken straight from the bytes are checked against those of the decoded strings as well. Covers every code point (in
+// every form that the decoder accepts, and at every offset from a run of ASCII that the vectorized
+// path may consume), every sequence of up to three bytes, random longer sequences, and every
+// truncation of a valid sequence. Prints one JSON object:
+//
+//   {"bench": "utf8_check", "strings": N, "widths": M, "mismatches": K}
+//
+// and the first few mismatches to stderr; exits with 1 if there are any.
+
+#include "truncated_text.h"
+#include "utf8.h"
+
+#include <locale.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+
+enum {
+    NCODEPOINTS = 0x110000,
+    // Longest string checked: the ASCII prefix, the longest sequence, and the suffix.
+    MAX_STRING = 64,
+    MAX_REPORTED = 10,
+};
+
+static uint64_t nstrings;
+static uint64_t nwidths;
+static uint64_t nmismatches;
+
+static void report(const char *what, const unsigned char *s, size_t ns)
+{
+    if (++nmismatches > MAX_REPORTED)
+        return;
+    fprintf(stderr, "utf8_check: %s mismatch for", what);
+    for (size_t i = 0; i < ns; ++i) {
+        fprintf(stderr, " %02x", s[i]);
+    }
+    fputc('\n', stderr);
+}
+
+// The reference: decodes with mbrtowc(), stopping at a null byte. Returns -1 on an invalid or
+// incomplete sequence.
+static ssize_t libc_decode(const unsigned char *s, size_t ns, wchar_t *out)
+{
+    mbstate_t state = {0};
+    size_t n = 0;
+    size_t i = 0;
+    while (i < ns) {
+        wchar_t c;
+        size_t r = mbrtowc(&c, (const char *) s + i, ns - i, &state);
+        if (r == (size_t) -1 || r == (size_t) -2)
+            return -1;
+        if (r == 0)
+            break;
+        out[n++] = c;
+        i += r;
+    }
+    return n;
+}
+
+static void check_string(const unsigned char *s, size_t ns)
+{
+    static wchar_t *buf;
+    static size_t nbuf;
+    wchar_t expected[MAX_STRING];
+
+    ++nstrings;
+    ssize_t want = libc_decode(s, ns, expected);
+    ssize_t got = utf8_decode_append((const char *) s, ns, &buf, &nbuf, 0);
+    if (got != want || (got >= 0 && memcmp(buf, expected, got * sizeof(wchar_t)) != 0)) {
+        report("decode", s, ns);
+    }
+    ssize_t width = utf8_text_width((const char *) s, ns);
+    if (want < 0 ? width != -1 : width != text_width(expected, want)) {
+        report("text width", s, ns);
+    }
+}
+
+// Encodes 'cp' in the original form of UTF-8 (up to 6 bytes, up to 0x7FFFFFFF), surrogates included.
+static size_t encode(uint32_t cp, unsigned char *out)
+{
+    if (cp < 0x80) {
+        out[0] = cp;
+        return 1;
+    }
+    size_t len = cp < 0x800 ? 2 : cp < 0x10000 ? 3 : cp < 0x200000 ? 4 : cp < 0x4000000 ? 5 : 6;
+    for (size_t i = len - 1; i > 0; --i) {
+        out[i] = 0x80 | (cp & 0x3F);
+        cp >>= 6;
+    }
+    out[0] = (0xFF00 >> len) | cp;
+    return len;
+}
+
+// Checks 'seq' with 'prefix' ASCII bytes before it and an ASCII byte after it.
+static void check_in_context(const unsigned char *seq, size_t nseq, size_t prefix)
+{
+    unsigned char s[MAX_STRING];
+    memset(s, 'a', prefix);
+    memcpy(s + prefix, seq, nseq);
+    s[prefix + nseq] = 'z';
+    check_string(s, prefix + nseq + 1);
+}
+
+static uint64_t xorshift64(uint64_t *x)
+{
+    *x ^= *x << 13;
+    *x ^= *x >> 7;
+    *x ^= *x << 17;
+    return *x;
+}
+
+int main(void)
+{
+    static const char *locales[] = {"C.UTF-8", "C.utf8", "en_US.UTF-8", "en_US.utf8"};
+    const char *loc = NULL;
+    for (size_t i = 0; i < sizeof(locales) / sizeof(locales[0]); ++i) {
+        if (setlocale(LC_CTYPE, locales[i])) {
+            loc = locales[i];
+            break;
+        }
+    }
+    if (!loc) {
+        fputs("utf8_check: no UTF-8 locale available.\n", stderr);
+        return 1;
+    }
+    utf8_init();
+    if (!utf8_enabled) {
+        fputs("utf8_check: the self-contained decoder is not used with this locale.\n", stderr);
+        return 1;
+    }
+
+    // Every code point: its width, and its encoding (and every truncation of it) after 0 to 33
+    // ASCII bytes, so that it lands on every position of a 16-byte block and past one.
+    unsigned char seq[8];
+    for (uint32_t cp = 0; cp < NCODEPOINTS; ++cp) {
+        ++nwidths;
+        if (utf8_wcwidth(cp) != wcwidth(cp)) {
+            report("width", seq, encode(cp, seq));
+        }
+        size_t len = encode(cp, seq);
+        check_in_context(seq, len, cp % 34);
+        for (size_t n = 1; n < len; ++n) {
+            check_in_context(seq, n, cp % 34);
+            check_string(seq, n);
+        }
+    }
+    // Past the last code point, in the longer forms.
+    for (uint64_t cp = NCODEPOINTS; cp <= 0x7FFFFFFF; cp += 0x1235) {
+        ++nwidths;
+        if (utf8_wcwidth(cp) != wcwidth(cp)) {
+            report("width", seq, encode(cp, seq));
+        }
+        check_in_context(seq, encode(cp, seq), cp % 34);
+    }
+
+    // Every sequence of one, two and three bytes (null bytes included), valid or not.
+    unsigned char s[MAX_STRING];
+    for (unsigned a = 0; a < 256; ++a) {
+        s[0] = a;
+        check_string(s, 1);
+        for (unsigned b = 0; b < 256; ++b) {
+            s[1] = b;
+            check_string(s, 2);
+            if (a < 0x80)
+                continue;
+            for (unsigned c = 0; c < 256; ++c) {
+                s[2] = c;
+                check_string(s, 3);
+            }
+        }
+    }
+
+    // Random longer strings, mostly made of lead bytes of long forms and continuation bytes.
+    static const unsigned char alphabet[] = {
+        'a', 0x00, 0x7F, 0x80, 0x8F, 0x90, 0xBF, 0xC0, 0xC1, 0xC2, 0xDF, 0xE0, 0xED, 0xEF,
+        0xF0, 0xF4, 0xF5, 0xF7, 0xF8, 0xFB, 0xFC, 0xFD, 0xFE, 0xFF,
+    };
+    uint64_t x = 88172645463325252u;
+    for (int i = 0; i < 4000000; ++i) {
+        size_t n = 4 + xorshift64(&x) % 6;
+        for (size_t j = 0; j < n; ++j) {
+            uint64_t r = xorshift64(&x);
+            s[j] = r % 3 ? 0x80 | (r >> 8) % 0x40 : alphabet[(r >> 8) % sizeof(alphabet)];
+        }
+        check_string(s, n);
+    }
+
+    printf("{\"bench\": \"utf8_check\", \"strings\": %llu, \"widths\": %llu, \"mismatches\": %llu}\n",
+           (unsigned long long) nstrings, (unsigned long long) nwidths, (unsigned long long) nmismatches);
+    return nmismatches ? 1 : 0;
+}
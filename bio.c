@@ -1,88 +1,172 @@
 #include "bio.h"
 #include "common.h"
+#include "trace.h"
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
 #include <limits.h>
 
-static void append_chunk(
-    char **pbuf, size_t *psize, size_t *pcapacity,
-    const char *chunk, size_t nchunk)
+// Moves the data that has to be kept (from the mark, if any, otherwise from 'offset') to the
+// beginning of the buffer.
+static void move_to_front(Bio *bio)
 {
-    while (*pcapacity - *psize < nchunk) {
-        *pbuf = x2realloc_or_die(*pbuf, pcapacity, sizeof(char));
+    size_t from = bio->marked ? bio->mark : bio->offset;
+    if (!from)
+        return;
+    if (bio->size != from) {
+        memmove(bio->buf, bio->buf + from, bio->size - from);
     }
-    if (nchunk) {
-        memcpy(*pbuf + *psize, chunk, nchunk);
-    }
-    *psize += nchunk;
-    if (*psize > (size_t) SSIZE_MAX) {
-        die_out_of_memory();
+    bio->size -= from;
+    bio->offset -= from;
+    if (bio->marked) {
+        bio->mark = 0;
     }
 }
 
-ssize_t bio_read_line(Bio *bio, char **pbuf, size_t *pcapacity, int *caught_signal)
+// Makes room for at least 'need' bytes of unconsumed data plus some free space after it, moving the
+// unconsumed data to the beginning of the buffer if needed. Marked data counts as unconsumed.
+static void make_room(Bio *bio, size_t need)
 {
-    size_t psize = 0;
+    size_t from = bio->marked ? bio->mark : bio->offset;
+    if (from == bio->size) {
+        bio->offset -= from;
+        bio->size = 0;
+        if (bio->marked) {
+            bio->mark = 0;
+        }
+        from = 0;
+    }
 
-    if (bio->offset != bio->size) {
-        char *s = bio->buf + bio->offset;
-        size_t ns = bio->size - bio->offset;
+    size_t nunconsumed = bio->size - from;
+    need += bio->offset - from;
 
-        char *nl = memchr(s, '\n', ns);
-        if (nl) {
-            size_t nline = nl + 1 - s;
-            append_chunk(
-                pbuf, &psize, pcapacity,
-                s, nline);
-            bio->offset += nline;
-            return psize;
+    if (from && bio->capacity - bio->size < bio->capacity / 4) {
+        move_to_front(bio);
+    }
+
+    size_t capacity = bio->capacity ? bio->capacity : BIO_MIN_NBUF;
+    while (capacity < need || capacity - nunconsumed < BIO_MIN_NBUF / 2) {
+        if (capacity > SIZE_MAX / 2 || capacity > (size_t) SSIZE_MAX) {
+            die_out_of_memory();
         }
+        capacity *= 2;
+    }
+    if (capacity != bio->capacity) {
+        move_to_front(bio);
+        bio->buf = realloc_or_die(bio->buf, capacity, sizeof(char));
+        bio->capacity = capacity;
+    }
+}
+
+// Performs a single read() into the free space of the buffer. Returns the number of bytes read, 0 on
+// EOF, or -1 on error.
+static ssize_t fill(Bio *bio, size_t need, int *caught_signal)
+{
+    make_room(bio, need);
+
+    size_t nfree = bio->capacity - bio->size;
+    ssize_t r;
+    int64_t started = trace_begin();
+    while ((r = read(bio->fd, bio->buf + bio->size, nfree)) < 0 && errno == EINTR) {
+        *caught_signal = 1;
+    }
+    trace_end("read", started);
+    ++bio->nreads;
+    bio->would_block = r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+    if (r <= 0) {
+        return r;
     }
+    bio->nbytes += r;
+    bio->size += r;
 
-    append_chunk(
-        pbuf, &psize, pcapacity,
-        bio->buf + bio->offset, bio->size - bio->offset);
+    // The producer is faster than us: let the next read() take more.
+    if ((size_t) r == nfree && bio->capacity < BIO_MAX_NBUF) {
+        make_room(bio, bio->capacity * 2);
+    }
+    return r;
+}
 
+ssize_t bio_read_line(Bio *bio, char **pline, int *caught_signal)
+{
     for (;;) {
-        ssize_t r;
-        while ((r = read(bio->fd, bio->buf, BIO_NBUF)) < 0 && errno == EINTR) {
-            *caught_signal = 1;
+        char *s = bio->buf + bio->offset;
+        size_t ns = bio->size - bio->offset;
+
+        if (ns > bio->scanned) {
+            char *nl = memchr(s + bio->scanned, '\n', ns - bio->scanned);
+            if (nl) {
+                size_t nline = nl + 1 - s;
+                bio->offset += nline;
+                bio->scanned = 0;
+                *pline = s;
+                return nline;
+            }
+            bio->scanned = ns;
         }
+
+        ssize_t r = fill(bio, ns + 1, caught_signal);
         if (r < 0) {
-            bio->offset = 0;
-            bio->size = 0;
             return -1;
-        } else if (r == 0) {
-            bio->offset = 0;
-            bio->size = 0;
-            return psize;
-        } else {
-            char *nl = memchr(bio->buf, '\n', r);
-            if (nl) {
-                size_t nline = nl + 1 - bio->buf;
-                append_chunk(
-                    pbuf, &psize, pcapacity,
-                    bio->buf, nline);
-                bio->offset = nline;
-                bio->size = r;
-                return psize;
-            }
-            append_chunk(
-                pbuf, &psize, pcapacity,
-                bio->buf, r);
+        }
+        if (r == 0) {
+            *pline = bio->buf + bio->offset;
+            bio->offset = bio->size;
+            bio->scanned = 0;
+            return ns;
         }
     }
 }
 
+ssize_t bio_read_exact(Bio *bio, char **pdata, size_t n, int *caught_signal)
+{
+    bio->scanned = 0;
+    while (bio->size - bio->offset < n) {
+        ssize_t r = fill(bio, n, caught_signal);
+        if (r < 0) {
+            return -1;
+        }
+        if (r == 0) {
+            n = bio->size - bio->offset;
+            break;
+        }
+    }
+    *pdata = bio->buf + bio->offset;
+    bio->offset += n;
+    return n;
+}
+
 int bio_has_something(Bio *bio)
 {
     return bio->offset != bio->size;
 }
 
+void bio_mark(Bio *bio)
+{
+    bio->marked = true;
+    bio->mark = bio->offset;
+}
+
+void bio_rewind(Bio *bio)
+{
+    bio->offset = bio->mark;
+    bio->scanned = 0;
+    bio->marked = false;
+}
+
+void bio_unmark(Bio *bio)
+{
+    bio->marked = false;
+}
+
 void bio_reset(Bio *bio)
 {
+    free(bio->buf);
+    bio->buf = NULL;
+    bio->capacity = 0;
     bio->size = 0;
     bio->offset = 0;
+    bio->scanned = 0;
+    bio->marked = false;
     bio->fd = -1;
 }
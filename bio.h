@@ -1,19 +1,59 @@
 #pragma once
 
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <sys/types.h>
 
-enum { BIO_NBUF = 1024 };
+// The buffer starts at BIO_MIN_NBUF bytes and doubles every time a read() fills all the free space,
+// up to BIO_MAX_NBUF bytes. It only grows past BIO_MAX_NBUF if a single line (or a single
+// 'bio_read_exact()' request) does not fit.
+enum {
+    BIO_MIN_NBUF = 64 * 1024,
+    BIO_MAX_NBUF = 16 * 1024 * 1024,
+};
 
 typedef struct {
-    char buf[BIO_NBUF];
+    char *buf;
+    size_t capacity;
+    // Unconsumed data is buf[offset; size).
     size_t size;
     size_t offset;
+    // How far (relative to 'offset') we have already searched for a newline.
+    size_t scanned;
     int fd;
+
+    // If 'marked' is set, the data from 'mark' on is kept in the buffer even once consumed, so that
+    // 'bio_rewind()' can go back to it.
+    bool marked;
+    size_t mark;
+
+    // Set if the last read() failed because 'fd' is non-blocking and there was nothing to read.
+    bool would_block;
+
+    // Number of read() calls made and bytes read so far.
+    uint64_t nreads;
+    uint64_t nbytes;
 } Bio;
 
-ssize_t bio_read_line(Bio *bio, char **pbuf, size_t *pcapacity, int *caught_signal);
+// Reads a line and stores a pointer to it, which points into the buffer and is valid until the next
+// call on 'bio', to '*pline'. Returns the length of the line including the newline character. On
+// EOF, the rest of the data (possibly empty) is returned without a newline. Returns -1 on error.
+ssize_t bio_read_line(Bio *bio, char **pline, int *caught_signal);
+
+// Makes 'n' bytes available in the buffer, stores a pointer to them (valid until the next call on
+// 'bio') to '*pdata' and consumes them. Returns less than 'n' on EOF, or -1 on error.
+ssize_t bio_read_exact(Bio *bio, char **pdata, size_t n, int *caught_signal);
 
 int bio_has_something(Bio *bio);
 
+// Remembers the current position, so that the data consumed from now on can be read again.
+void bio_mark(Bio *bio);
+
+// Goes back to the position remembered by 'bio_mark()' and forgets it.
+void bio_rewind(Bio *bio);
+
+// Forgets the position remembered by 'bio_mark()'.
+void bio_unmark(Bio *bio);
+
 void bio_reset(Bio *bio);
@@ -5,12 +5,27 @@
 #include "parse_uint.h"
 #include "print_uint.h"
 #include "bio.h"
+#include "itree.h"
+#include "varint.h"
+#include "arena.h"
+#include "utf8.h"
+#include "pacer.h"
+#include "match.h"
+#include "pool.h"
+#include "trigram.h"
+#include "keymap.h"
+#include "linefile.h"
+#include "stats.h"
+#include "trace.h"
+#include "snapshot.h"
 
 #include <wchar.h>
 #include <curses.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <stdint.h>
+#include <inttypes.h>
 #include <string.h>
 #include <stdbool.h>
 #include <stdarg.h>
@@ -22,12 +37,69 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <errno.h>
+#include <signal.h>
 
 typedef struct {
-    // The columns of this entry; valid indices are [0; list->ncols).
-    TruncatedText *cols;
+    // The text as received, null-terminated.
+    const char *raw;
+    size_t nraw;
+
+    // Decoded when the cell is drawn for the first time; until then, NULL. The wide characters are
+    // allocated in the same arena block, right past the structure.
+    TruncatedText *text;
+} ListCell;
+
+typedef struct {
+    // Must be the first member: we convert between 'ITreeNode *' and 'ListEntry *'.
+    ITreeNode node;
+
+    // The node in 'list->sorted'; unused unless the list is sorted.
+    ITreeNode sorted_node;
+
+    // Size of the arena block holding this structure, the columns and their raw text.
+    size_t nbytes;
+
+    // Id in the trigram index, or zero if the entry is not in the index.
+    uint32_t index_id;
+
+    // Whether the widths of the cells are accounted for in the auto-width columns.
+    bool measured;
+
+    // The key of the entry if the list is keyed, otherwise NULL. Points into the same arena block,
+    // right before the raw text of the columns; null-terminated.
+    const char *key;
+    size_t nkey;
+
+    // The columns of this entry; valid indices are [0; list->ncols). Points right past this
+    // structure; the raw text of the columns follows.
+    ListCell *cols;
 } ListEntry;
 
+enum {
+    // In virtual mode, rows are requested, cached and evicted in windows of this many rows.
+    VIRTUAL_WINDOW = 256,
+
+    // The widest an auto-width column can get if no maximum is given.
+    AUTO_WIDTH_LIMIT = 4096,
+};
+
+typedef struct VirtualWindow {
+    // The window holds rows [num * VIRTUAL_WINDOW; (num + 1) * VIRTUAL_WINDOW); 'num' is also its
+    // key in 'list->windows'.
+    uint64_t num;
+
+    // The value of 'list->window_stamp' when the window was last needed for a frame. Windows needed
+    // for the current frame are never evicted.
+    uint64_t stamp;
+
+    // Neighbours in the list of cached windows, which goes from the most to the least recently used.
+    struct VirtualWindow *prev;
+    struct VirtualWindow *next;
+
+    // NULL for rows that have not arrived yet.
+    ListEntry *rows[VIRTUAL_WINDOW];
+} VirtualWindow;
+
 typedef struct {
     // If negative, this column has fixed width of (-w).
     // If non-negative, this column has variable width of TOTAL_WIDTH * (w / list->vw_denom).
@@ -35,6 +107,16 @@ typedef struct {
 
     // Current width, calculated according to the rule above with TOTAL_WIDTH = list->width.
     uint32_t cur_width;
+
+    // If set, 'w' is unused, and the column is as wide as its widest cell (the header included) plus
+    // one for the gap, but no less than 'auto_min' and no more than 'auto_max'. 'nwidths[W]' is the
+    // number of cells of width W (W <= 'auto_max'; wider cells are counted as 'auto_max'), so that
+    // 'widest' can be kept up to date as cells come and go without looking at the other cells.
+    bool is_auto;
+    uint32_t auto_min;
+    uint32_t auto_max;
+    uint64_t *nwidths;
+    uint32_t widest;
 } ListColumn;
 
 typedef struct {
@@ -42,6 +124,59 @@ typedef struct {
     bool with_index;
 } CustomCommand;
 
+// When packs are acknowledged (see '-ack=').
+typedef enum {
+    ACK_EVERY,
+    ACK_NONE,
+    ACK_BATCH,
+    ACK_AFTER_RENDER,
+} AckPolicy;
+
+// Time spent on a pack (or on several packs acknowledged together), in nanoseconds: in total, and on
+// changing the list; the rest is reading and parsing. When tracing, also when the header of the pack
+// (or of the first of them) has been read.
+typedef struct {
+    int64_t total;
+    int64_t apply;
+    int64_t arrived;
+} PackTiming;
+
+// A controlling process (or one of several, see '-infd='): the commands it sends, and the state of
+// its pack being applied and of its acknowledgements.
+typedef struct {
+    Bio infile;
+
+    int outfd;
+
+    // The pack being applied, which can take more than one step (see 'handle_infile_step()'): the
+    // number of its commands that are still to be read, and, if a '==' command is halfway through,
+    // the index of its next entry and the number of entries still to be read. The indices are those
+    // of the segment of the list that the source owns.
+    bool in_pack;
+    uint64_t pack_left;
+    uint64_t range_next;
+    uint64_t range_left;
+
+    // Number of entries in the segment.
+    uint64_t size;
+
+    // Whether the last step over the input stopped before running out of input.
+    bool more;
+
+    // With 'ack_timing': the pack being applied, and when the current step over the input started
+    // (or the last pack of the step was complete).
+    PackTiming pack_timing;
+    int64_t pack_clock;
+
+    // Packs that are complete but not acknowledged yet: with ACK_BATCH, their number and their
+    // summed timing; with ACK_AFTER_RENDER, their timings.
+    uint64_t nbatched;
+    PackTiming batch_timing;
+    PackTiming *unacked;
+    size_t nunacked;
+    size_t cunacked;
+} Source;
+
 typedef struct {
     // Number of columns.
     size_t ncols;
@@ -49,8 +184,8 @@ typedef struct {
     // The descriptions of the columns; valid indices are [0; list->ncols).
     ListColumn *cols;
 
-    // The headers of the columns; valid indices are [0; list->ncols).
-    TruncatedText *headers;
+    // The headers of the columns; valid indices are [0; list->ncols). These are decoded up front.
+    ListCell *headers;
 
     // The "denominator" for variable-width columns.
     uint32_t vw_denom;
@@ -58,11 +193,25 @@ typedef struct {
     // The sum of widths of fixed-width columns.
     uint32_t fw_sum;
 
-    ListEntry *entries;
-    size_t size;
-    size_t capacity;
-
-    // Index of the selected entry. If size is zero, then selected is also zero.
+    // Whether there are auto-width columns, and whether the width of one of them has changed since
+    // the last 'update_column_widths()'.
+    bool auto_widths;
+    bool widths_changed;
+
+    // The entries, in order; the nodes are embedded into 'ListEntry' structures.
+    ITree entries;
+
+    // If 'sorting' is set, the entries are shown sorted by column 'sort_col' (as numbers if
+    // 'sort_numeric' is set, otherwise as strings, according to the locale), and 'sorted' holds
+    // them in that order.
+    bool sorting;
+    size_t sort_col;
+    bool sort_numeric;
+    bool sort_desc;
+    ITree sorted;
+
+    // Index of the selected entry among the visible entries of the view (see 'list_view()'). If
+    // there are none, then selected is zero.
     size_t selected;
 
     // Current height and width.
@@ -73,11 +222,27 @@ typedef struct {
     InternedStyle style_highlight;
     InternedStyle style_entry;
 
-    Bio infile;
-    char *infile_buf;
-    size_t infile_nbuf;
+    // Holds the entries and their text.
+    Arena arena;
 
-    int outfd;
+    // Scratch space for reading the columns of a single entry before it is allocated.
+    size_t *scratch_offsets;
+    char *scratch_raw;
+    size_t scratch_nraw;
+
+    // Scratch space for a null-terminated copy of a command line. The input buffer itself is never
+    // written to, since a command that has not arrived in full is read again from its start.
+    char *scratch_line;
+    size_t scratch_nline;
+
+    // Scratch space for decoding a cell.
+    wchar_t *scratch_text;
+    size_t scratch_ntext;
+    uint32_t *scratch_widths;
+    size_t scratch_nwidths;
+
+    // Whether the length-prefixed binary protocol is used instead of the line-based one.
+    bool binary;
 
     bool need_more_size;
 
@@ -88,6 +253,124 @@ typedef struct {
     char current_command;
 
     char info_buf[512];
+
+    // Damage tracking for 'redraw()'. If 'dirty_all' is set, everything is repainted; otherwise,
+    // only the rows showing entries in [dirty_from; dirty_to), the rows whose selection state
+    // changed, the rows exposed by scrolling, and the first line if the info message or the command
+    // line changed.
+    bool dirty_all;
+    uint64_t dirty_from;
+    uint64_t dirty_to;
+
+    // What was shown on the last frame.
+    size_t drawn_from;
+    size_t drawn_selected;
+    char drawn_command;
+    char drawn_info[512];
+
+    // Scratch space for 'redraw()'; valid indices are [0; list->height).
+    bool *row_dirty;
+
+    // Decides when the main loop calls 'redraw()'.
+    Pacer pacer;
+
+    // The filter query; empty if there is none. While there is one, only the entries that match it
+    // are visible (see 'ITreeNode'), and 'selected' and the damaged rows count visible entries only.
+    char filter_query[256];
+    size_t nfilter_query;
+    Matcher filter_matcher;
+    // Whether the query is being typed in.
+    bool filter_editing;
+
+    // The visibility of the entries is brought in line with the query by a scan that proceeds in
+    // batches, starting from position 'filter_cursor'. Entries before it are up to date, and so are
+    // the ones added since the query changed. If 'filter_scan_all' is not set, only the visible
+    // entries are scanned, as the query only got longer since the visible entries were up to date.
+    bool filter_scanning;
+    bool filter_scan_all;
+    uint64_t filter_cursor;
+
+    // The workers that do the matching, and scratch space for the entries being matched. Allocated
+    // when first needed.
+    size_t filter_nthreads;
+    Pool *filter_pool;
+    ListEntry **filter_batch;
+    bool *filter_matches;
+    size_t filter_nbatch;
+
+    // Whether the trigram index is maintained; if so, queries of at least three bytes are looked
+    // up in it instead of being scanned for.
+    bool indexed;
+    TrigramIndex index;
+
+    // The filter line as shown on the last frame.
+    char drawn_filter[512];
+
+    // Whether the entries are added, changed and deleted by key rather than by position. If so,
+    // every entry has a key, and 'keys' maps the keys to the entries.
+    bool keyed;
+    KeyMap keys;
+
+    // Whether the list is virtual (see '-virtual'): the controlling process only announces the
+    // number of rows, 'virtual_count', and sends the rows that cmenu asks for. If so, 'entries' stays
+    // empty; the rows that have arrived are cached in windows, at most 'max_windows' of them (more
+    // if that many are needed for a single frame), and the least recently used window is evicted.
+    bool virtual;
+    uint64_t virtual_count;
+    KeyMap windows;
+    VirtualWindow *windows_head;
+    VirtualWindow *windows_tail;
+    size_t nwindows;
+    size_t max_windows;
+    uint64_t window_stamp;
+
+    // Where the rows shown on the frame of the last fetch started, and whether the list was scrolled
+    // up to get there; the rows ahead in the direction of scrolling are prefetched.
+    uint64_t fetched_from;
+    bool scrolling_up;
+
+    // Number of 'get' requests written, and of rows they asked for.
+    uint64_t nrequests;
+    uint64_t nrequested_rows;
+
+    // Whether the rows are the records of a file (see '-file='), which are drawn straight from the
+    // mapping. If so, 'entries' stays empty. While 'file_scanning' is set, more records are being
+    // looked for.
+    bool from_file;
+    bool file_scanning;
+    LineFile file;
+
+    // The snapshot the list is being loaded from (see '-load-snapshot='). While 'snapshot_loading' is
+    // set, its entries are added in steps, and the input fd is not read. The entries around the one
+    // that was selected, [snapshot_from; snapshot_to), are added first, then the ones before them,
+    // and then the ones after them.
+    Snapshot snapshot;
+    bool snapshot_loading;
+    uint64_t snapshot_from;
+    uint64_t snapshot_to;
+
+    // Where the commands come from and where their acknowledgements go: one source per '-infd=', in
+    // order, each owning a segment of the list that follows the segments of the sources before it.
+    // 'src' is the source being read from or written to; the result goes to the first one.
+    Source *sources;
+    size_t nsources;
+    Source *src;
+
+    // What to write once the pack being applied is complete, if the user has asked for it in the
+    // middle of the pack: '\n' for the result, or the spelling of a custom command; otherwise, '\0'.
+    char exit_pending;
+
+    // Whether cmenu keeps running after writing the result or a custom command (see '-persistent').
+    bool persistent;
+
+    // Whether a 'quit' command has been applied; cmenu quits once its pack is complete.
+    bool quit_pending;
+
+    // The acknowledgement policy; with ACK_BATCH, every 'ack_batch'-th pack is acknowledged. If
+    // 'ack_timing' is set, the acknowledgements say how long the packs took.
+    AckPolicy ack_policy;
+    uint64_t ack_batch;
+    bool ack_timing;
 } List;
 
 static char global_errmsg[1024];
@@ -116,225 +399,1677 @@ static int full_write(int fd, const char *buf, size_t nbuf, int *caught_signal)
     return 0;
 }
 
-static int say(List *list, const char *s, int *caught_signal)
+static int say_bytes(List *list, const char *buf, size_t nbuf, int *caught_signal)
 {
-    if (full_write(list->outfd, s, strlen(s), caught_signal) < 0) {
+    if (full_write(list->src->outfd, buf, nbuf, caught_signal) < 0) {
         errmsgf("Cannot write to output fd: %s\n", strerror(errno));
         return -1;
     }
     return 0;
 }
 
-static void list_entry_free(List *list, ListEntry entry)
+static int say(List *list, const char *s, int *caught_signal)
 {
-    for (size_t i = 0; i < list->ncols; ++i) {
-        free(entry.cols[i].s);
-    }
-    free(entry.cols);
+    return say_bytes(list, s, strlen(s), caught_signal);
 }
 
-static void list_add(List *list, ListEntry entry)
+// Writes 'text' in text mode, or the single byte 'tag' in binary mode.
+static int say_tag(List *list, const char *text, char tag, int *caught_signal)
 {
-    if (list->size == list->capacity) {
-        list->entries = x2realloc_or_die(list->entries, &list->capacity, sizeof(ListEntry));
+    if (list->binary) {
+        return say_bytes(list, &tag, 1, caught_signal);
     }
-    list->entries[list->size++] = entry;
+    return say(list, text, caught_signal);
 }
 
-static bool list_del(List *list, uint64_t idx)
+static inline ListEntry *entry_of(ITreeNode *node)
 {
-    if (idx >= list->size)
-        return false;
+    return (ListEntry *) node;
+}
 
-    list_entry_free(list, list->entries[idx]);
+static inline ListEntry *entry_of_sorted(ITreeNode *node)
+{
+    return (ListEntry *) (((char *) node) - offsetof(ListEntry, sorted_node));
+}
 
-    if (list->selected > 0 && list->selected >= idx)
-        --list->selected;
+// The tree whose order is shown: 'list->sorted' if the list is sorted, 'list->entries' otherwise.
+// The visibility of entries is tracked in this tree only.
+static inline ITree *list_view(List *list)
+{
+    return list->sorting ? &list->sorted : &list->entries;
+}
+
+static inline ITreeNode *view_node_of(List *list, ListEntry *entry)
+{
+    return list->sorting ? &entry->sorted_node : &entry->node;
+}
 
-    for (size_t i = idx + 1; i < list->size; ++i)
-        list->entries[i - 1] = list->entries[i];
+static inline ListEntry *entry_of_view(List *list, ITreeNode *node)
+{
+    return list->sorting ? entry_of_sorted(node) : entry_of(node);
+}
 
-    --list->size;
+static inline size_t list_size(List *list)
+{
+    return itree_size(&list->entries);
+}
 
-    return true;
+// Position in the list of the first entry of the segment of 'src'.
+static uint64_t list_source_base(List *list, const Source *src)
+{
+    uint64_t base = 0;
+    for (const Source *cur = list->sources; cur != src; ++cur) {
+        base += cur->size;
+    }
+    return base;
 }
 
-static bool list_set(List *list, uint64_t idx, ListEntry entry)
+// Whether any source is halfway through a pack.
+static bool list_in_pack(List *list)
 {
-    if (idx >= list->size)
-        return false;
+    for (size_t i = 0; i < list->nsources; ++i) {
+        if (list->sources[i].in_pack)
+            return true;
+    }
+    return false;
+}
+
+static inline size_t list_nvisible(List *list)
+{
+    if (list->virtual)
+        return list->virtual_count;
+    if (list->from_file)
+        return list->file.nrecords;
+    return itree_nvisible(list_view(list));
+}
 
-    list_entry_free(list, list->entries[idx]);
+static inline bool list_filtering(List *list)
+{
+    return list->nfilter_query != 0;
+}
 
-    list->entries[idx] = entry;
+static bool entry_matches(const Matcher *m, size_t ncols, const ListEntry *entry)
+{
+    for (size_t i = 0; i < ncols; ++i) {
+        if (matcher_match(m, entry->cols[i].raw, entry->cols[i].nraw))
+            return true;
+    }
+    return false;
+}
 
+// Parses a number at the start of 's' (after any spaces): an optional sign, digits, and optionally a
+// dot followed by more digits. The rest of 's' is ignored.
+static bool parse_sort_number(const char *s, double *out)
+{
+    while (*s == ' ')
+        ++s;
+    bool negative = false;
+    if (*s == '-' || *s == '+') {
+        negative = *s == '-';
+        ++s;
+    }
+    if (!(*s >= '0' && *s <= '9'))
+        return false;
+    double r = 0;
+    for (; *s >= '0' && *s <= '9'; ++s)
+        r = r * 10 + (*s - '0');
+    if (*s == '.') {
+        double scale = 1;
+        for (++s; *s >= '0' && *s <= '9'; ++s) {
+            scale /= 10;
+            r += (*s - '0') * scale;
+        }
+    }
+    *out = negative ? -r : r;
     return true;
 }
 
-static void list_clear(List *list)
+typedef struct {
+    const char *s;
+    bool is_number;
+    double number;
+} SortKey;
+
+static inline void sort_key_of(List *list, const ListEntry *entry, SortKey *key)
 {
-    for (size_t i = 0; i < list->size; ++i)
-        list_entry_free(list, list->entries[i]);
-    list->size = 0;
-    list->selected = 0;
+    key->s = entry->cols[list->sort_col].raw;
+    key->is_number = list->sort_numeric && parse_sort_number(key->s, &key->number);
 }
 
-static void list_selection_up(List *list, uint32_t lines)
+// Numeric keys that do not parse as numbers come last, ordered as strings.
+static int compare_sort_keys(List *list, const SortKey *x, const SortKey *y)
 {
-    if (list->selected < lines) {
-        list->selected = 0;
+    int r;
+    if (x->is_number != y->is_number) {
+        return x->is_number ? -1 : 1;
+    } else if (x->is_number) {
+        r = (x->number > y->number) - (x->number < y->number);
     } else {
-        list->selected -= lines;
+        r = strcoll(x->s, y->s);
     }
+    return list->sort_desc ? -r : r;
 }
 
-static void list_selection_down(List *list, uint32_t lines)
+static int compare_entries(List *list, const ListEntry *a, const ListEntry *b)
 {
-    if (list->size == 0) {
-        list->selected = 0;
-    } else {
-        uint64_t s = ((uint64_t) list->selected) + lines;
-        list->selected = s < list->size ? s : list->size - 1;
+    SortKey x;
+    SortKey y;
+    sort_key_of(list, a, &x);
+    sort_key_of(list, b, &y);
+    return compare_sort_keys(list, &x, &y);
+}
+
+typedef struct {
+    List *list;
+    SortKey key;
+    // The position of the entry in the list, and whether it is the last one (as it usually is, which
+    // saves computing the positions of the entries it is compared to).
+    size_t rank;
+    bool last;
+} SortSearch;
+
+// Whether the node of the sorted tree comes before the entry being searched for. Entries with equal
+// keys are kept in the order of the list.
+static bool sorts_before(const ITreeNode *node, void *userdata)
+{
+    SortSearch *search = userdata;
+    ListEntry *cur = entry_of_sorted((ITreeNode *) node);
+    SortKey key;
+    sort_key_of(search->list, cur, &key);
+    int r = compare_sort_keys(search->list, &key, &search->key);
+    if (r)
+        return r < 0;
+    return search->last || itree_rank(&cur->node) < search->rank;
+}
+
+// Size of the arena block holding a decoded cell: the structure, then the cumulative widths (if
+// any), then the wide characters.
+static inline size_t cell_text_nbytes(const TruncatedText *t)
+{
+    size_t nwidths = t->widths ? t->n : 0;
+    return sizeof(TruncatedText) + nwidths * sizeof(uint32_t) + (t->n + 1) * sizeof(wchar_t);
+}
+
+// Returns the width of a cell as it is drawn.
+static uint32_t cell_width(List *list, const char *raw, size_t nraw)
+{
+    size_t i = 0;
+    while (i < nraw && raw[i] >= 0x20 && raw[i] < 0x7F) {
+        ++i;
+    }
+    if (i == nraw) {
+        return nraw < UINT32_MAX ? nraw : UINT32_MAX;
+    }
+    if (utf8_enabled) {
+        // Without decoding the cell, which is left to the first time it is drawn.
+        ssize_t w = utf8_text_width(raw, nraw);
+        if (w < 0) {
+            return strlen("(encoding error)");
+        }
+        return w < UINT32_MAX ? w : UINT32_MAX;
+    }
+    ssize_t r = decode_append(raw, nraw, &list->scratch_text, &list->scratch_ntext, 0);
+    if (r < 0) {
+        return strlen("(encoding error)");
     }
+    return text_width(list->scratch_text, r);
 }
 
-static void update_column_widths(List *list)
+static inline uint32_t auto_column_width(const ListColumn *col)
 {
-    uint32_t total_vw = list->width;
-    if (total_vw < list->fw_sum) {
-        list->need_more_size = true;
+    uint32_t w = col->widest + 1;
+    if (w < col->auto_min)
+        return col->auto_min;
+    return w < col->auto_max ? w : col->auto_max;
+}
+
+// Accounts for a cell of width 'w' coming to ('delta' = 1) or leaving ('delta' = -1) an auto-width
+// column.
+static void auto_column_count(List *list, ListColumn *col, uint32_t w, int delta)
+{
+    if (w > col->auto_max) {
+        w = col->auto_max;
+    }
+    uint32_t old = auto_column_width(col);
+    col->nwidths[w] += delta;
+    if (w > col->widest) {
+        col->widest = w;
+    } else if (w == col->widest) {
+        while (col->widest && !col->nwidths[col->widest]) {
+            --col->widest;
+        }
+    }
+    if (auto_column_width(col) != old) {
+        list->widths_changed = true;
+    }
+}
+
+// Accounts for the cells of 'entry' coming to ('delta' = 1) or leaving ('delta' = -1) the list.
+static void list_entry_measure(List *list, ListEntry *entry, int delta)
+{
+    if (!list->auto_widths || entry->measured == (delta > 0))
         return;
+    for (size_t i = 0; i < list->ncols; ++i) {
+        ListColumn *col = &list->cols[i];
+        if (col->is_auto) {
+            auto_column_count(list, col, cell_width(list, entry->cols[i].raw, entry->cols[i].nraw), delta);
+        }
     }
-    total_vw -= list->fw_sum;
+    entry->measured = delta > 0;
+}
 
-    uint32_t vw_sum = 0;
-    size_t last_vw = -1;
+// Forgets the widths of all the cells but the headers.
+static void list_reset_auto_widths(List *list)
+{
+    if (!list->auto_widths)
+        return;
+    for (size_t i = 0; i < list->ncols; ++i) {
+        ListColumn *col = &list->cols[i];
+        if (col->is_auto) {
+            memset(col->nwidths, 0, (col->auto_max + 1) * sizeof(uint64_t));
+            col->widest = 0;
+            auto_column_count(list, col, cell_width(list, list->headers[i].raw, list->headers[i].nraw), 1);
+        }
+    }
+    list->widths_changed = true;
+}
 
+static void list_entry_free(List *list, ListEntry *entry)
+{
+    list_entry_measure(list, entry, -1);
+    if (entry->index_id) {
+        trigram_index_remove(&list->index, entry->index_id);
+    }
+    if (entry->key) {
+        key_map_remove(&list->keys, entry->key, entry->nkey, entry);
+    }
     for (size_t i = 0; i < list->ncols; ++i) {
-        int32_t w = list->cols[i].w;
-        if (w >= 0) {
-            uint32_t cur_width = ((uint64_t) total_vw) * w / list->vw_denom;
-            vw_sum += cur_width;
-            last_vw = i;
-            list->cols[i].cur_width = cur_width;
-        } else {
-            list->cols[i].cur_width = -w;
+        TruncatedText *t = entry->cols[i].text;
+        if (t) {
+            arena_free(&list->arena, t, cell_text_nbytes(t));
         }
     }
+    arena_free(&list->arena, entry, entry->nbytes);
+}
 
-    if (last_vw != (size_t) -1) {
-        list->cols[last_vw].cur_width += total_vw - vw_sum;
+static void list_entry_free_cb(ITreeNode *node, void *userdata)
+{
+    list_entry_free(userdata, entry_of(node));
+}
+
+// Puts 'entry' into the key map and the trigram index, if they are maintained, and accounts for its
+// cells in the auto-width columns.
+static void list_entry_index(List *list, ListEntry *entry)
+{
+    list_entry_measure(list, entry, 1);
+    if (entry->key)
+        key_map_put(&list->keys, entry->key, entry->nkey, entry);
+    if (!list->indexed)
+        return;
+    for (size_t i = 0; i < list->ncols; ++i)
+        trigram_index_feed(&list->index, entry->cols[i].raw, entry->cols[i].nraw);
+    entry->index_id = trigram_index_commit(&list->index, entry);
+}
+
+// Marks the rows showing entries at positions [from; to) of the view as needing to be repainted.
+static void list_damage(List *list, uint64_t from, uint64_t to)
+{
+    if (list_filtering(list)) {
+        // The rows show visible entries only.
+        from = itree_nvisible_before(list_view(list), from);
+        if (to != UINT64_MAX)
+            to = itree_nvisible_before(list_view(list), to);
     }
+    if (from >= to)
+        return;
+    if (list->dirty_from >= list->dirty_to) {
+        list->dirty_from = from;
+        list->dirty_to = to;
+    } else {
+        if (from < list->dirty_from)
+            list->dirty_from = from;
+        if (to > list->dirty_to)
+            list->dirty_to = to;
+    }
+}
 
-    list->need_more_size = false;
+static inline void list_damage_from(List *list, uint64_t from)
+{
+    list_damage(list, from, UINT64_MAX);
 }
 
-static void draw_row(List *list, int y, TruncatedText *cols)
+// Adjusts the selection after a visible entry has been inserted so that 'vidx' visible entries are
+// before it.
+static void list_selection_inserted(List *list, size_t vidx)
 {
-    uint32_t cur_x = 0;
-    for (size_t i = 0; i < list->ncols; ++i) {
-        uint32_t w = list->cols[i].cur_width;
-        TruncatedText *t = &cols[i];
-        truncate_text_to_width(t, w);
-        mvaddnwstr(y, cur_x, t->s, t->truncated_n);
-        cur_x += w;
+    if (list_nvisible(list) > 1 && list->selected >= vidx)
+        ++list->selected;
+}
+
+// Adjusts the selection after 'vcount' visible entries that had 'vfrom' visible entries before them
+// have been removed or hidden.
+static void list_selection_removed(List *list, size_t vfrom, size_t vcount)
+{
+    if (list->selected >= vfrom + vcount) {
+        list->selected -= vcount;
+    } else if (list->selected >= vfrom) {
+        list->selected = vfrom ? vfrom - 1 : 0;
     }
 }
 
-static void draw_row_styled(List *list, int y, TruncatedText *cols, InternedStyle style)
+// Selects 'node' (a node of the view) if it is visible; otherwise, the first visible entry after it,
+// or the last one.
+static void list_select_node(List *list, ITreeNode *node)
 {
-    attr_set(style.a, style.cpn, NULL);
-    mvhline(y, 0, ' ', list->width);
-    draw_row(list, y, cols);
+    size_t nvisible = list_nvisible(list);
+    if (!node || !nvisible) {
+        list->selected = 0;
+        return;
+    }
+    size_t vidx = itree_nvisible_before(list_view(list), itree_rank(node));
+    list->selected = vidx < nvisible ? vidx : nvisible - 1;
 }
 
-static void redraw(List *list, bool requery_size)
+static inline ListEntry *list_selected_entry(List *list)
 {
-    erase();
+    ITreeNode *node = itree_at_visible(list_view(list), list->selected);
+    return node ? entry_of_view(list, node) : NULL;
+}
 
-    if (requery_size) {
-        int height;
-        int width;
-        getmaxyx(stdscr, height, width);
-        list->height = height;
-        list->width = width;
-        update_column_widths(list);
+// Returns the position of the selected entry in the list (which is what the protocol indices refer
+// to), not in the view.
+static uint64_t list_selected_position(List *list)
+{
+    if (list->virtual || list->from_file)
+        return list->selected;
+    ListEntry *entry = list_selected_entry(list);
+    return entry ? itree_rank(&entry->node) : 0;
+}
+
+// Must be called once 'entry' has been put into 'list->entries'. Puts it into the index and the
+// view, and updates the selection, the filter scan and the damage.
+static void list_entry_added(List *list, ListEntry *entry)
+{
+    list_entry_index(list, entry);
+
+    if (list->sorting) {
+        size_t rank = itree_rank(&entry->node);
+        SortSearch search = {.list = list, .rank = rank, .last = rank + 1 == list_size(list)};
+        sort_key_of(list, entry, &search.key);
+        itree_insert(&list->sorted, itree_search(&list->sorted, sorts_before, &search), &entry->sorted_node);
     }
 
-    if (list->height < 3 || list->width < 3 || list->need_more_size) {
-        attr_set(0, 0, NULL);
-        mvaddstr(0, 0, "(Need more size)");
-        goto done;
+    ITreeNode *vnode = view_node_of(list, entry);
+    size_t vpos = itree_rank(vnode);
+
+    if (list_filtering(list)) {
+        if (list->filter_scanning && vpos < list->filter_cursor)
+            ++list->filter_cursor;
+        if (!entry_matches(&list->filter_matcher, list->ncols, entry)) {
+            itree_set_visible(vnode, false);
+            return;
+        }
     }
 
-    draw_row_styled(list, 0, list->headers, list->style_header);
+    list_selection_inserted(list, itree_nvisible_before(list_view(list), vpos));
+    list_damage_from(list, vpos);
+}
 
-    if (list->info_buf[0]) {
-        attr_set(0, 0, NULL);
-        mvaddstr(0, 0, list->info_buf);
+// Must be called before 'entry' is taken out of 'list->entries'. Takes it out of the view (unless
+// the view is 'list->entries' itself), and updates the selection, the filter scan and the damage.
+static void list_entry_removing(List *list, ListEntry *entry)
+{
+    ITreeNode *vnode = view_node_of(list, entry);
+    size_t vpos = itree_rank(vnode);
+    size_t vidx = itree_nvisible_before(list_view(list), vpos);
+    bool visible = itree_is_visible(vnode);
+
+    if (list->sorting)
+        itree_remove(&list->sorted, vpos);
+
+    if (list->filter_scanning && vpos < list->filter_cursor)
+        --list->filter_cursor;
+
+    if (visible) {
+        list_damage_from(list, vpos);
+        list_selection_removed(list, vidx, 1);
+    }
+}
+
+static void list_entry_removing_cb(ITreeNode *node, void *userdata)
+{
+    list_entry_removing(userdata, entry_of(node));
+    list_entry_free(userdata, entry_of(node));
+}
+
+// If 'idx' is greater than the size of the list, the entry is appended.
+static void list_add(List *list, uint64_t idx, ListEntry *entry)
+{
+    size_t size = list_size(list);
+    if (idx > size)
+        idx = size;
+
+    itree_insert(&list->entries, idx, &entry->node);
+    list_entry_added(list, entry);
+}
+
+static bool list_del(List *list, uint64_t idx)
+{
+    ITreeNode *node = itree_at(&list->entries, idx);
+    if (!node)
+        return false;
+
+    list_entry_removing(list, entry_of(node));
+    itree_remove(&list->entries, idx);
+    list_entry_free(list, entry_of(node));
+    return true;
+}
+
+static void list_del_range(List *list, uint64_t from, uint64_t count)
+{
+    size_t size = list_size(list);
+    if (from >= size)
+        return;
+    if (count > size - from)
+        count = size - from;
+
+    ITree cut;
+
+    if (list->sorting) {
+        // The entries are scattered all over the view.
+        itree_cut(&list->entries, from, count, &cut);
+        itree_destroy(&cut, list_entry_removing_cb, list);
+        return;
     }
 
-    if (list->size) {
-        int64_t idx_from = ((int64_t) list->selected) - ((int64_t) (list->height / 2));
-        if (idx_from < 0)
-            idx_from = 0;
+    size_t vfrom = itree_nvisible_before(&list->entries, from);
+    size_t vcount = itree_nvisible_before(&list->entries, from + count) - vfrom;
+
+    itree_cut(&list->entries, from, count, &cut);
+    itree_destroy(&cut, list_entry_free_cb, list);
 
-        uint64_t idx_to = idx_from + list->height - 1;
-        if (idx_to > list->size)
-            idx_to = list->size;
+    if (list->filter_scanning && from < list->filter_cursor) {
+        uint64_t before = list->filter_cursor - from;
+        list->filter_cursor -= before < count ? before : count;
+    }
+
+    list_damage_from(list, from);
+    list_selection_removed(list, vfrom, vcount);
+}
 
-        int selected_y = 0;
+// Puts 'entry' in place of 'old', which is at position 'idx', and frees 'old'.
+static void list_replace(List *list, uint64_t idx, ITreeNode *old, ListEntry *entry)
+{
+    if (list->sorting) {
+        // The key might have changed, so the entry might move. If it was selected, it stays so.
+        bool was_selected = list_selected_entry(list) == entry_of(old);
+        list_entry_removing(list, entry_of(old));
+        itree_replace(&list->entries, old, &entry->node);
+        list_entry_free(list, entry_of(old));
+        list_entry_added(list, entry);
+        if (was_selected && itree_is_visible(&entry->sorted_node))
+            list_select_node(list, &entry->sorted_node);
+        return;
+    }
 
-        for (size_t i = idx_from; i < idx_to; ++i) {
-            int y = i - idx_from + 1;
-            if (list->selected == i) {
-                selected_y = y;
-                draw_row_styled(list, y, list->entries[i].cols, list->style_highlight);
+    itree_replace(&list->entries, old, &entry->node);
+    list_entry_free(list, entry_of(old));
+    list_entry_index(list, entry);
+
+    if (list_filtering(list)) {
+        bool visible = entry_matches(&list->filter_matcher, list->ncols, entry);
+        if (visible != itree_is_visible(&entry->node)) {
+            size_t vidx = itree_nvisible_before(&list->entries, idx);
+            itree_set_visible(&entry->node, visible);
+            if (visible) {
+                list_selection_inserted(list, vidx);
             } else {
-                draw_row_styled(list, y, list->entries[i].cols, list->style_entry);
+                list_selection_removed(list, vidx, 1);
             }
+            list_damage_from(list, idx);
+            return;
         }
+    }
 
-        move(selected_y, 0);
+    list_damage(list, idx, idx + 1);
+}
 
-    } else {
-        move(1, 0);
+static bool list_set(List *list, uint64_t idx, ListEntry *entry)
+{
+    ITreeNode *old = itree_at(&list->entries, idx);
+    if (!old) {
+        list_entry_free(list, entry);
+        return false;
     }
 
-    if (list->current_command) {
-        char buf[3];
-        if (list->current_command == ':') {
-            buf[0] = ':';
-            buf[1] = '\0';
-        } else {
-            buf[0] = ':';
-            buf[1] = list->current_command;
-            buf[2] = '\0';
-        }
-        attr_set(0, 0, NULL);
-        mvaddstr(0, 0, buf);
-    }
+    list_replace(list, idx, old, entry);
+    return true;
+}
 
-done:
-    refresh();
+static inline VirtualWindow *virtual_window(List *list, uint64_t num)
+{
+    return key_map_get(&list->windows, (const char *) &num, sizeof(num));
 }
 
-static int say_uint(List *list, uint64_t x, int *caught_signal)
+// Returns the row with index 'idx' of a virtual list, or NULL if it is not in the cache.
+static ListEntry *virtual_row(List *list, uint64_t idx)
 {
-    char buf[32];
-    size_t n = print_uint(buf, x);
-    buf[n++] = '\n';
-    buf[n++] = '\0';
-    return say(list, buf, caught_signal);
+    VirtualWindow *w = virtual_window(list, idx / VIRTUAL_WINDOW);
+    return w ? w->rows[idx % VIRTUAL_WINDOW] : NULL;
+}
+
+static void virtual_window_unlink(List *list, VirtualWindow *w)
+{
+    if (w->prev) {
+        w->prev->next = w->next;
+    } else {
+        list->windows_head = w->next;
+    }
+    if (w->next) {
+        w->next->prev = w->prev;
+    } else {
+        list->windows_tail = w->prev;
+    }
+}
+
+static void virtual_window_push_front(List *list, VirtualWindow *w)
+{
+    w->prev = NULL;
+    w->next = list->windows_head;
+    if (w->next) {
+        w->next->prev = w;
+    } else {
+        list->windows_tail = w;
+    }
+    list->windows_head = w;
+}
+
+static void virtual_window_drop(List *list, VirtualWindow *w)
+{
+    key_map_remove(&list->windows, (const char *) &w->num, sizeof(w->num), w);
+    virtual_window_unlink(list, w);
+    for (size_t i = 0; i < VIRTUAL_WINDOW; ++i) {
+        if (w->rows[i]) {
+            list_entry_free(list, w->rows[i]);
+        }
+    }
+    free(w);
+    --list->nwindows;
+}
+
+// Returns the cached window 'num', marked as needed for the current frame; creates it, with no
+// rows, if it is not cached, and then sets '*created'.
+static VirtualWindow *virtual_window_use(List *list, uint64_t num, bool *created)
+{
+    VirtualWindow *w = virtual_window(list, num);
+    *created = !w;
+    if (w) {
+        virtual_window_unlink(list, w);
+    } else {
+        if (list->nwindows >= list->max_windows && list->windows_tail->stamp != list->window_stamp) {
+            virtual_window_drop(list, list->windows_tail);
+        }
+        w = calloc_or_die(1, sizeof(VirtualWindow));
+        w->num = num;
+        key_map_put(&list->windows, (const char *) &w->num, sizeof(w->num), w);
+        ++list->nwindows;
+    }
+    w->stamp = list->window_stamp;
+    virtual_window_push_front(list, w);
+    return w;
+}
+
+// Stores a row of a virtual list that has arrived. It is thrown away if its window is not cached
+// (any more), as it has not been asked for.
+static void list_virtual_store(List *list, uint64_t idx, ListEntry *entry)
+{
+    VirtualWindow *w = idx < list->virtual_count ? virtual_window(list, idx / VIRTUAL_WINDOW) : NULL;
+    if (!w) {
+        list_entry_free(list, entry);
+        return;
+    }
+    ListEntry **slot = &w->rows[idx % VIRTUAL_WINDOW];
+    if (*slot) {
+        list_entry_free(list, *slot);
+    }
+    *slot = entry;
+    list_entry_measure(list, entry, 1);
+    list_damage(list, idx, idx + 1);
+}
+
+// Sets the number of rows of a virtual list. The windows past the smaller of the old and the new
+// number are dropped, so that rows that come into existence get asked for.
+static void list_virtual_set_count(List *list, uint64_t count)
+{
+    uint64_t keep = count < list->virtual_count ? count : list->virtual_count;
+    for (VirtualWindow *w = list->windows_head; w;) {
+        VirtualWindow *next = w->next;
+        if ((w->num + 1) * VIRTUAL_WINDOW > keep) {
+            virtual_window_drop(list, w);
+        }
+        w = next;
+    }
+    list->virtual_count = count;
+    if (list->selected >= count) {
+        list->selected = count ? count - 1 : 0;
+    }
+    list_damage_from(list, keep);
+}
+
+// Writes a request for 'count' rows starting at 'from'.
+static int say_get(List *list, uint64_t from, uint64_t count, int *caught_signal)
+{
+    char buf[64];
+    size_t n;
+    if (list->binary) {
+        buf[0] = 'g';
+        n = 1;
+        n += varint_encode(buf + n, from);
+        n += varint_encode(buf + n, count);
+    } else {
+        n = snprintf(buf, sizeof(buf), "get %" PRIu64 " %" PRIu64 "\n", from, count);
+    }
+    ++list->nrequests;
+    list->nrequested_rows += count;
+    return say_bytes(list, buf, n, caught_signal);
+}
+
+// Marks the windows covering rows [from; to) as needed for the current frame, and asks for the ones
+// that are not cached. Adjacent windows are asked for with a single request.
+static int list_virtual_want(List *list, uint64_t from, uint64_t to, int *caught_signal)
+{
+    if (to > list->virtual_count)
+        to = list->virtual_count;
+    if (from >= to)
+        return 0;
+
+    uint64_t last = (to - 1) / VIRTUAL_WINDOW;
+    uint64_t run_from = 0;
+    uint64_t run_size = 0;
+    for (uint64_t num = from / VIRTUAL_WINDOW; num <= last; ++num) {
+        bool created;
+        virtual_window_use(list, num, &created);
+        if (created) {
+            if (!run_size)
+                run_from = num;
+            ++run_size;
+        }
+        if (run_size && (!created || num == last)) {
+            uint64_t row_from = run_from * VIRTUAL_WINDOW;
+            uint64_t row_to = (run_from + run_size) * VIRTUAL_WINDOW;
+            if (row_to > list->virtual_count)
+                row_to = list->virtual_count;
+            if (say_get(list, row_from, row_to - row_from, caught_signal) < 0)
+                return -1;
+            run_size = 0;
+        }
+    }
+    return 0;
+}
+
+// Must be called after a frame has been rendered. Asks for the rows of a virtual list that the frame
+// showed as placeholders, and for a screenful of rows ahead in the direction of scrolling. Never
+// waits for the rows to arrive.
+static int list_virtual_fetch(List *list, int *caught_signal)
+{
+    if (!list->virtual || list->height < 3)
+        return 0;
+
+    // A virtual list has a single source.
+    list->src = list->sources;
+    uint64_t from = list->drawn_from;
+    uint64_t nrows = list->height - 1;
+    if (from != list->fetched_from) {
+        list->scrolling_up = from < list->fetched_from;
+        list->fetched_from = from;
+    }
+
+    ++list->window_stamp;
+    if (list_virtual_want(list, from, from + nrows, caught_signal) < 0)
+        return -1;
+    if (list->scrolling_up) {
+        return list_virtual_want(list, from > nrows ? from - nrows : 0, from, caught_signal);
+    }
+    return list_virtual_want(list, from + nrows, from + 2 * nrows, caught_signal);
+}
+
+// Drops all the windows of a virtual list without freeing the rows (which the caller frees all at
+// once).
+static void list_virtual_forget(List *list)
+{
+    while (list->windows_head) {
+        VirtualWindow *w = list->windows_head;
+        list->windows_head = w->next;
+        free(w);
+    }
+    list->windows_tail = NULL;
+    list->nwindows = 0;
+    key_map_clear(&list->windows);
+    list->virtual_count = 0;
+}
+
+// Replaces the entry with the same key as 'entry', or appends 'entry' if there is none.
+static void list_upsert(List *list, ListEntry *entry)
+{
+    ListEntry *old = key_map_get(&list->keys, entry->key, entry->nkey);
+    if (old) {
+        list_replace(list, itree_rank(&old->node), &old->node, entry);
+    } else {
+        list_add(list, list_size(list), entry);
+    }
+}
+
+static bool list_del_key(List *list, const char *key, size_t nkey)
+{
+    ListEntry *entry = key_map_get(&list->keys, key, nkey);
+    if (!entry)
+        return false;
+    return list_del(list, itree_rank(&entry->node));
+}
+
+static void list_clear(List *list)
+{
+    // All the entries live in the arena, so there is no need to visit them.
+    list->entries.root = NULL;
+    list->sorted.root = NULL;
+    arena_reset(&list->arena);
+    if (list->indexed) {
+        trigram_index_clear(&list->index);
+    }
+    key_map_clear(&list->keys);
+    list_virtual_forget(list);
+    list->selected = 0;
+    list->filter_scanning = false;
+    list_reset_auto_widths(list);
+    list_damage_from(list, 0);
+}
+
+enum {
+    FILTER_BATCH = 16 * 1024,
+    FILTER_CHUNK = 1024,
+};
+
+typedef struct {
+    const Matcher *matcher;
+    size_t ncols;
+    ListEntry **entries;
+    bool *matches;
+} FilterJob;
+
+static void filter_job_run(void *userdata, size_t from, size_t to)
+{
+    FilterJob *job = userdata;
+    for (size_t i = from; i < to; ++i)
+        job->matches[i] = entry_matches(job->matcher, job->ncols, job->entries[i]);
+}
+
+static void list_filter_reserve(List *list, size_t n)
+{
+    if (list->filter_nbatch >= n)
+        return;
+    list->filter_nbatch = n;
+    list->filter_batch = realloc_or_die(list->filter_batch, n, sizeof(ListEntry *));
+    list->filter_matches = realloc_or_die(list->filter_matches, n, sizeof(bool));
+}
+
+// Matches 'list->filter_batch[0; n)' against the query, storing the results to
+// 'list->filter_matches'.
+static void list_filter_match(List *list, size_t n)
+{
+    if (!list->filter_pool) {
+        list->filter_pool = pool_new(list->filter_nthreads);
+    }
+    FilterJob job = {
+        .matcher = &list->filter_matcher,
+        .ncols = list->ncols,
+        .entries = list->filter_batch,
+        .matches = list->filter_matches,
+    };
+    pool_run(list->filter_pool, n, FILTER_CHUNK, filter_job_run, &job);
+}
+
+// Makes exactly the entries that match the query visible, using the trigram index. Returns false if
+// there is no index or the query is too short for it.
+static bool list_filter_from_index(List *list)
+{
+    void **items;
+    size_t n;
+    if (!list->indexed || !trigram_index_lookup(&list->index, list->filter_query, list->nfilter_query, &items, &n))
+        return false;
+
+    list_filter_reserve(list, n);
+    for (size_t i = 0; i < n; ++i)
+        list->filter_batch[i] = items[i];
+    list_filter_match(list, n);
+
+    // Hiding all the entries takes constant time, so the cost only depends on the candidates.
+    ITree *t = list_view(list);
+    itree_set_all_visible(t, false);
+    for (size_t i = 0; i < n; ++i) {
+        if (list->filter_matches[i])
+            itree_set_visible(view_node_of(list, list->filter_batch[i]), true);
+    }
+    return true;
+}
+
+// Must be called after the query has changed. 'longer' tells whether the old query is a prefix of
+// the new one; if so, the entries that do not match the old query cannot match the new one either.
+static void list_filter_restart(List *list, bool longer)
+{
+    ITreeNode *selected = itree_at_visible(list_view(list), list->selected);
+
+    matcher_init(&list->filter_matcher, list->filter_query, list->nfilter_query);
+    if (!list_filtering(list)) {
+        list->filter_scanning = false;
+        itree_set_all_visible(list_view(list), true);
+        list_select_node(list, selected);
+    } else if (list_filter_from_index(list)) {
+        list->filter_scanning = false;
+        list_select_node(list, selected);
+    } else {
+        // An unfinished scan of all the entries leaves the ones past the cursor in an unknown state.
+        list->filter_scan_all = !longer || (list->filter_scanning && list->filter_scan_all);
+        list->filter_scanning = true;
+        list->filter_cursor = 0;
+    }
+
+    list_damage_from(list, 0);
+}
+
+// Matches the next batch of entries of the view against the query and shows or hides them
+// accordingly.
+static void list_filter_step(List *list)
+{
+    list_filter_reserve(list, FILTER_BATCH);
+
+    ITree *t = list_view(list);
+    bool all = list->filter_scan_all;
+    ITreeNode *node = all
+        ? itree_at(t, list->filter_cursor)
+        : itree_at_visible(t, itree_nvisible_before(t, list->filter_cursor));
+
+    size_t n = 0;
+    ITreeNode *last = NULL;
+    while (node && n < FILTER_BATCH) {
+        list->filter_batch[n++] = entry_of_view(list, node);
+        last = node;
+        node = all ? itree_next(node) : itree_next_visible(node);
+    }
+    if (!node)
+        list->filter_scanning = false;
+    if (!n)
+        return;
+
+    list_filter_match(list, n);
+
+    ITreeNode *selected = itree_at_visible(t, list->selected);
+    ITreeNode *first_changed = NULL;
+    for (size_t i = 0; i < n; ++i) {
+        ITreeNode *cur = view_node_of(list, list->filter_batch[i]);
+        if (itree_is_visible(cur) != list->filter_matches[i]) {
+            if (!first_changed)
+                first_changed = cur;
+            itree_set_visible(cur, list->filter_matches[i]);
+        }
+    }
+    list->filter_cursor = itree_rank(last) + 1;
+
+    if (first_changed) {
+        list_select_node(list, selected);
+        list_damage_from(list, itree_rank(first_changed));
+    }
+}
+
+// Sorts 'order[0; n)', the indices of 'entries', by the sort keys of the entries; entries with equal
+// keys keep their relative order. 'tmp' must have room for 'n' elements.
+static void merge_sort_entries(List *list, ListEntry **entries, size_t *order, size_t *tmp, size_t n)
+{
+    for (size_t width = 1; width < n; width *= 2) {
+        for (size_t lo = 0; lo < n; lo += 2 * width) {
+            size_t mid = n - lo > width ? lo + width : n;
+            size_t hi = n - mid > width ? mid + width : n;
+            size_t i = lo;
+            size_t j = mid;
+            size_t k = lo;
+            while (i < mid && j < hi) {
+                if (compare_entries(list, entries[order[j]], entries[order[i]]) < 0) {
+                    tmp[k++] = order[j++];
+                } else {
+                    tmp[k++] = order[i++];
+                }
+            }
+            while (i < mid)
+                tmp[k++] = order[i++];
+            while (j < hi)
+                tmp[k++] = order[j++];
+        }
+        memcpy(order, tmp, n * sizeof(size_t));
+    }
+}
+
+// Switches to sorting by column 'col' (if 'sorting' is set) or to showing the list as is, and
+// rebuilds the view. The selected entry, and the visibility of the entries, stay the same.
+static void list_set_sort(List *list, bool sorting, size_t col, bool numeric, bool desc)
+{
+    ListEntry *selected = list_selected_entry(list);
+
+    size_t n = list_size(list);
+    ListEntry **entries = malloc_or_die(n, sizeof(ListEntry *));
+    bool *visible = malloc_or_die(n, sizeof(bool));
+    size_t i = 0;
+    for (ITreeNode *node = itree_at(&list->entries, 0); node; node = itree_next(node), ++i) {
+        entries[i] = entry_of(node);
+        visible[i] = itree_is_visible(view_node_of(list, entries[i]));
+    }
+
+    list->sorting = sorting;
+    list->sort_col = col;
+    list->sort_numeric = numeric;
+    list->sort_desc = desc;
+
+    if (sorting) {
+        size_t *order = malloc_or_die(n, sizeof(size_t));
+        size_t *tmp = malloc_or_die(n, sizeof(size_t));
+        for (i = 0; i < n; ++i)
+            order[i] = i;
+        merge_sort_entries(list, entries, order, tmp, n);
+
+        list->sorted.root = NULL;
+        for (i = 0; i < n; ++i) {
+            ListEntry *entry = entries[order[i]];
+            itree_insert(&list->sorted, i, &entry->sorted_node);
+            if (!visible[order[i]])
+                itree_set_visible(&entry->sorted_node, false);
+        }
+        free(order);
+        free(tmp);
+    } else {
+        itree_set_all_visible(&list->entries, true);
+        for (i = 0; i < n; ++i) {
+            if (!visible[i])
+                itree_set_visible(&entries[i]->node, false);
+        }
+    }
+
+    free(entries);
+    free(visible);
+
+    // The scan position means nothing in the new order.
+    if (list->filter_scanning) {
+        list->filter_scan_all = true;
+        list->filter_cursor = 0;
+    }
+
+    list_select_node(list, selected ? view_node_of(list, selected) : NULL);
+    list_damage_from(list, 0);
+}
+
+static void list_selection_up(List *list, uint32_t lines)
+{
+    if (list->selected < lines) {
+        list->selected = 0;
+    } else {
+        list->selected -= lines;
+    }
+}
+
+static void list_selection_down(List *list, uint32_t lines)
+{
+    if (list_nvisible(list) == 0) {
+        list->selected = 0;
+    } else {
+        uint64_t s = ((uint64_t) list->selected) + lines;
+        list->selected = s < list_nvisible(list) ? s : list_nvisible(list) - 1;
+    }
+}
+
+static void update_column_widths(List *list)
+{
+    list->widths_changed = false;
+    uint32_t total_vw = list->width;
+    if (total_vw < list->fw_sum) {
+        list->need_more_size = true;
+        return;
+    }
+    total_vw -= list->fw_sum;
+
+    // Auto-width columns take what they need from what is left, in order.
+    for (size_t i = 0; i < list->ncols; ++i) {
+        if (list->cols[i].is_auto) {
+            uint32_t w = auto_column_width(&list->cols[i]);
+            if (w > total_vw) {
+                w = total_vw;
+            }
+            list->cols[i].cur_width = w;
+            total_vw -= w;
+        }
+    }
+
+    uint32_t vw_sum = 0;
+    size_t last_vw = -1;
+
+    for (size_t i = 0; i < list->ncols; ++i) {
+        int32_t w = list->cols[i].w;
+        if (list->cols[i].is_auto) {
+            continue;
+        }
+        if (w >= 0) {
+            uint32_t cur_width = ((uint64_t) total_vw) * w / list->vw_denom;
+            vw_sum += cur_width;
+            last_vw = i;
+            list->cols[i].cur_width = cur_width;
+        } else {
+            list->cols[i].cur_width = -w;
+        }
+    }
+
+    if (last_vw != (size_t) -1) {
+        list->cols[last_vw].cur_width += total_vw - vw_sum;
+    }
+
+    list->need_more_size = false;
+}
+
+// Decodes a cell into 'list->scratch_text'; returns the number of wide characters stored, not
+// counting the terminating null character.
+static size_t decode_cell_to_scratch(List *list, const char *raw, size_t nraw)
+{
+    if (global_stats) {
+        global_stats->ndecoded += nraw;
+    }
+    int64_t started = trace_begin();
+    ssize_t r = decode_append(raw, nraw, &list->scratch_text, &list->scratch_ntext, 0);
+    if (r < 0) {
+        const char msg[] = "(encoding error)";
+        r = decode_append(msg, sizeof(msg) - 1, &list->scratch_text, &list->scratch_ntext, 0);
+    }
+    trace_end("decode", started);
+    if (r > INT_MAX) {
+        r = INT_MAX;
+        list->scratch_text[r] = L'\0';
+    }
+    return r;
+}
+
+static TruncatedText *cell_text(List *list, ListCell *cell)
+{
+    if (!cell->text) {
+        size_t n = decode_cell_to_scratch(list, cell->raw, cell->nraw);
+        if (list->scratch_nwidths < n) {
+            list->scratch_nwidths = n;
+            list->scratch_widths = realloc_or_die(list->scratch_widths, n, sizeof(uint32_t));
+        }
+        TruncatedText tmp = {
+            .s = list->scratch_text,
+            .n = n,
+        };
+        bool uniform = truncated_text_prepare(&tmp, list->scratch_widths);
+        size_t nwidths = uniform ? 0 : n;
+
+        TruncatedText t_template = {
+            .n = n,
+            .widths = uniform ? NULL : list->scratch_widths,
+        };
+        TruncatedText *t = arena_alloc(&list->arena, cell_text_nbytes(&t_template));
+        uint32_t *widths = (uint32_t *) (t + 1);
+        *t = (TruncatedText) {
+            .s = (wchar_t *) (widths + nwidths),
+            .n = n,
+            .widths = uniform ? NULL : widths,
+        };
+        memcpy(widths, list->scratch_widths, nwidths * sizeof(uint32_t));
+        memcpy(t->s, list->scratch_text, (n + 1) * sizeof(wchar_t));
+        cell->text = t;
+    }
+    return cell->text;
+}
+
+static void draw_row(List *list, int y, ListCell *cols)
+{
+    uint32_t cur_x = 0;
+    for (size_t i = 0; i < list->ncols; ++i) {
+        uint32_t w = list->cols[i].cur_width;
+        TruncatedText *t = cell_text(list, &cols[i]);
+        int64_t started = trace_begin();
+        truncate_text_to_width(t, w);
+        trace_end("truncate", started);
+        mvaddnwstr(y, cur_x, t->s, t->truncated_n);
+        cur_x += w;
+    }
+}
+
+static void draw_row_styled(List *list, int y, ListCell *cols, InternedStyle style)
+{
+    attr_set(style.a, style.cpn, NULL);
+    mvhline(y, 0, ' ', list->width);
+    draw_row(list, y, cols);
+}
+
+// Draws record 'idx' of the file straight from the mapping. The cells are separated by tabs; extra
+// cells are not shown. They are decoded anew every time rather than kept, as there might be too many
+// records to keep anything per record.
+static void draw_file_row(List *list, int y, uint64_t idx, InternedStyle style)
+{
+    const char *s;
+    size_t ns;
+    line_file_record(&list->file, idx, &s, &ns);
+    if (list->file.sep == '\n' && ns && s[ns - 1] == '\r') {
+        --ns;
+    }
+
+    attr_set(style.a, style.cpn, NULL);
+    mvhline(y, 0, ' ', list->width);
+
+    uint32_t cur_x = 0;
+    for (size_t i = 0; i < list->ncols; ++i) {
+        const char *tab = memchr(s, '\t', ns);
+        size_t ncell = tab ? (size_t) (tab - s) : ns;
+
+        size_t n = decode_cell_to_scratch(list, s, ncell);
+        if (list->scratch_nwidths < n) {
+            list->scratch_nwidths = n;
+            list->scratch_widths = realloc_or_die(list->scratch_widths, n, sizeof(uint32_t));
+        }
+        TruncatedText t = {
+            .s = list->scratch_text,
+            .n = n,
+        };
+        if (!truncated_text_prepare(&t, list->scratch_widths)) {
+            t.widths = list->scratch_widths;
+        }
+        uint32_t w = list->cols[i].cur_width;
+        int64_t started = trace_begin();
+        truncate_text_to_width(&t, w);
+        trace_end("truncate", started);
+        mvaddnwstr(y, cur_x, t.s, t.truncated_n);
+        cur_x += w;
+
+        s += tab ? ncell + 1 : ncell;
+        ns -= tab ? ncell + 1 : ncell;
+    }
+}
+
+enum {
+    // Bytes of the file scanned for records between events.
+    FILE_SCAN_STEP = 8 * 1024 * 1024,
+};
+
+static void list_file_step(List *list)
+{
+    uint64_t old = list->file.nrecords;
+    if (line_file_scan(&list->file, FILE_SCAN_STEP)) {
+        list->file_scanning = false;
+    }
+    list_damage(list, old, list->file.nrecords);
+}
+
+enum {
+    // Entries of the snapshot added between events.
+    SNAPSHOT_STEP = 64 * 1024,
+    // Entries around the selected one that are added by the first step, which are more than a
+    // screenful.
+    SNAPSHOT_FIRST = 1024,
+};
+
+// Adds the next entries of the snapshot being loaded; their cells point into the mapping. The first
+// step only adds the entries around the one that was selected, and selects it, so that the first
+// frame shows them. Returns -1 if the snapshot is corrupted.
+static int list_snapshot_step(List *list)
+{
+    Snapshot *s = &list->snapshot;
+    uint64_t n = s->header.nentries;
+    if (!s->nread) {
+        uint64_t sel = s->header.selected < n ? s->header.selected : 0;
+        list->snapshot_from = sel > SNAPSHOT_FIRST / 2 ? sel - SNAPSHOT_FIRST / 2 : 0;
+        list->snapshot_to = n - list->snapshot_from > SNAPSHOT_FIRST ? list->snapshot_from + SNAPSHOT_FIRST : n;
+    }
+    uint64_t from = list->snapshot_from;
+    uint64_t to = list->snapshot_to;
+
+    bool keyed = s->header.flags & SNAPSHOT_KEYED;
+    size_t nbytes = sizeof(ListEntry) + list->ncols * sizeof(ListCell);
+    uint64_t end = s->nread < to - from ? to - from : n;
+    for (size_t i = 0; i < SNAPSHOT_STEP && s->nread < end; ++i) {
+        // The entries around the selected one, then the ones before them backwards, then the rest:
+        // each one is added at an end of the list, which is much cheaper than in the middle.
+        uint64_t k = s->nread;
+        uint64_t idx = k < to - from ? from + k : k < to ? to - 1 - k : k;
+        ListEntry *entry = arena_alloc(&list->arena, nbytes);
+        *entry = (ListEntry) {
+            .nbytes = nbytes,
+            .cols = (ListCell *) (entry + 1),
+        };
+        bool ok = snapshot_seek_entry(s, idx) == 0;
+        ok = ok && (!keyed || snapshot_read_span(s, &entry->key, &entry->nkey) == 0);
+        for (size_t j = 0; ok && j < list->ncols; ++j) {
+            entry->cols[j] = (ListCell) {0};
+            ok = snapshot_read_span(s, &entry->cols[j].raw, &entry->cols[j].nraw) == 0;
+        }
+        if (!ok) {
+            arena_free(&list->arena, entry, nbytes);
+            list->snapshot_loading = false;
+            errmsgf("The snapshot is truncated (at entry %" PRIu64 ").\n", idx);
+            return -1;
+        }
+        list_add(list, idx < from ? 0 : list_size(list), entry);
+        // The snapshot is loaded into the segment of the only source.
+        ++list->sources[0].size;
+        ++s->nread;
+    }
+    if (s->nread == to - from && s->header.selected < n) {
+        // The selection follows the entry as the ones before it are added.
+        ITreeNode *node = itree_at(&list->entries, s->header.selected - from);
+        list_select_node(list, view_node_of(list, entry_of(node)));
+    }
+    if (s->nread == n) {
+        list->snapshot_loading = false;
+    }
+    return 0;
+}
+
+// Writes the list to a snapshot at 'path'. Returns -1 on failure (with errno set).
+static int list_save_snapshot(List *list, const char *path, const char *const *columns)
+{
+    ListEntry *selected = list_selected_entry(list);
+    SnapshotHeader h = {
+        .ncols = list->ncols,
+        .flags = list->keyed ? SNAPSHOT_KEYED : 0,
+        .selected = selected ? itree_rank(&selected->node) : UINT64_MAX,
+    };
+    SnapshotWriter w;
+    if (snapshot_write_begin(&w, path, &h, columns) < 0) {
+        return -1;
+    }
+    for (ITreeNode *node = itree_at(&list->entries, 0); node; node = itree_next(node)) {
+        ListEntry *entry = entry_of(node);
+        snapshot_write_entry(&w);
+        if (list->keyed) {
+            snapshot_write_span(&w, entry->key, entry->nkey);
+        }
+        for (size_t i = 0; i < list->ncols; ++i) {
+            snapshot_write_span(&w, entry->cols[i].raw, entry->cols[i].nraw);
+        }
+    }
+    return snapshot_write_end(&w);
+}
+
+// Formats the line that shows the filter query, or an empty string if there is nothing to show.
+static void format_filter_line(List *list, char *buf, size_t nbuf)
+{
+    if (!list->filter_editing && !list_filtering(list)) {
+        buf[0] = '\0';
+        return;
+    }
+    snprintf(
+        buf, nbuf, "/%.*s  [%s%zu/%zu]",
+        (int) list->nfilter_query, list->filter_query,
+        list->filter_scanning ? "searching: " : "",
+        list_nvisible(list), list_size(list));
+}
+
+// Returns the number of columns that the filter query takes up on the screen.
+static size_t filter_query_width(List *list)
+{
+    const char *q = list->filter_query;
+    size_t n = list->nfilter_query;
+    ssize_t w;
+    if (utf8_enabled) {
+        w = utf8_text_width(q, n);
+    } else {
+        ssize_t r = decode_append(q, n, &list->scratch_text, &list->scratch_ntext, 0);
+        w = r < 0 ? -1 : (ssize_t) text_width(list->scratch_text, r);
+    }
+    if (w >= 0) {
+        return w;
+    }
+    // A character that has not been typed to the end yet: one column for every character.
+    size_t x = 0;
+    for (size_t i = 0; i < n; ++i)
+        x += (q[i] & 0xC0) != 0x80;
+    return x;
+}
+
+static void draw_header(List *list, const char *filter_line)
+{
+    draw_row_styled(list, 0, list->headers, list->style_header);
+
+    if (list->info_buf[0]) {
+        attr_set(0, 0, NULL);
+        mvaddnstr(0, 0, list->info_buf, list->width);
+    }
+
+    if (filter_line[0]) {
+        attr_set(0, 0, NULL);
+        mvaddnstr(0, 0, filter_line, list->width);
+    }
+
+    if (list->current_command) {
+        char buf[3];
+        if (list->current_command == ':') {
+            buf[0] = ':';
+            buf[1] = '\0';
+        } else {
+            buf[0] = ':';
+            buf[1] = list->current_command;
+            buf[2] = '\0';
+        }
+        attr_set(0, 0, NULL);
+        mvaddstr(0, 0, buf);
+    }
+}
+
+static void redraw(List *list, bool requery_size)
+{
+    if (requery_size) {
+        int height;
+        int width;
+        getmaxyx(stdscr, height, width);
+        list->height = height;
+        list->width = width;
+        list->row_dirty = realloc_or_die(list->row_dirty, height > 0 ? height : 0, sizeof(bool));
+    }
+    if (requery_size || list->widths_changed) {
+        update_column_widths(list);
+        list->dirty_all = true;
+    }
+
+    if (list->height < 3 || list->width < 3 || list->need_more_size) {
+        if (list->dirty_all) {
+            erase();
+            attr_set(0, 0, NULL);
+            mvaddstr(0, 0, "(Need more size)");
+            int64_t started = trace_begin();
+            refresh();
+            trace_end("refresh", started);
+            list->dirty_all = false;
+        }
+        return;
+    }
+
+    size_t size = list_nvisible(list);
+    uint32_t nrows = list->height - 1;
+
+    int64_t scroll = ((int64_t) list->selected) - ((int64_t) (list->height / 2));
+    uint64_t idx_from = scroll > 0 ? (uint64_t) scroll : 0;
+    uint64_t idx_to = idx_from + nrows;
+
+    char filter_line[sizeof(list->drawn_filter)];
+    format_filter_line(list, filter_line, sizeof(filter_line));
+
+    bool *row_dirty = list->row_dirty;
+    bool header_dirty = list->dirty_all
+        || list->current_command != list->drawn_command
+        || strcmp(list->info_buf, list->drawn_info) != 0
+        || strcmp(filter_line, list->drawn_filter) != 0;
+    bool any_dirty = header_dirty;
+
+    if (list->dirty_all) {
+        erase();
+        for (uint32_t y = 0; y < nrows; ++y)
+            row_dirty[y] = true;
+        any_dirty = true;
+
+    } else {
+        for (uint32_t y = 0; y < nrows; ++y)
+            row_dirty[y] = false;
+
+        // Shift what is already on the screen, and only paint the rows that got exposed.
+        int64_t delta = (int64_t) idx_from - (int64_t) list->drawn_from;
+        if (delta) {
+            int64_t magnitude = delta < 0 ? -delta : delta;
+            if (magnitude < nrows) {
+                setscrreg(1, nrows);
+                scrollok(stdscr, TRUE);
+                scrl(delta);
+                scrollok(stdscr, FALSE);
+                setscrreg(0, list->height - 1);
+                if (delta > 0) {
+                    for (uint32_t y = nrows - magnitude; y < nrows; ++y)
+                        row_dirty[y] = true;
+                } else {
+                    for (uint32_t y = 0; y < magnitude; ++y)
+                        row_dirty[y] = true;
+                }
+            } else {
+                for (uint32_t y = 0; y < nrows; ++y)
+                    row_dirty[y] = true;
+            }
+            any_dirty = true;
+        }
+
+        if (list->dirty_from < list->dirty_to) {
+            uint64_t from = list->dirty_from > idx_from ? list->dirty_from : idx_from;
+            uint64_t to = list->dirty_to < idx_to ? list->dirty_to : idx_to;
+            for (uint64_t i = from; i < to; ++i) {
+                row_dirty[i - idx_from] = true;
+                any_dirty = true;
+            }
+        }
+
+        if (list->selected != list->drawn_selected) {
+            size_t both[2] = {list->selected, list->drawn_selected};
+            for (int k = 0; k < 2; ++k) {
+                if (both[k] >= idx_from && both[k] < idx_to) {
+                    row_dirty[both[k] - idx_from] = true;
+                    any_dirty = true;
+                }
+            }
+        }
+    }
+
+    list->dirty_all = false;
+    list->dirty_from = 0;
+    list->dirty_to = 0;
+
+    if (!any_dirty)
+        return;
+
+    ITreeNode *node = list->virtual ? NULL : itree_at_visible(list_view(list), idx_from);
+    for (uint32_t y = 0; y < nrows; ++y) {
+        size_t i = idx_from + y;
+        if (row_dirty[y]) {
+            InternedStyle style = list->selected == i ? list->style_highlight : list->style_entry;
+            if (node) {
+                draw_row_styled(list, y + 1, entry_of_view(list, node)->cols, style);
+            } else if (i < size && list->from_file) {
+                draw_file_row(list, y + 1, i, style);
+            } else if (i < size) {
+                // A row of a virtual list.
+                ListEntry *entry = virtual_row(list, i);
+                if (entry) {
+                    draw_row_styled(list, y + 1, entry->cols, style);
+                } else {
+                    attr_set(style.a, style.cpn, NULL);
+                    mvhline(y + 1, 0, ' ', list->width);
+                    mvaddnstr(y + 1, 0, "...", list->width);
+                }
+            } else {
+                attr_set(0, 0, NULL);
+                move(y + 1, 0);
+                clrtoeol();
+            }
+        }
+        if (node)
+            node = itree_next_visible(node);
+    }
+
+    if (header_dirty) {
+        draw_header(list, filter_line);
+        snprintf(list->drawn_info, sizeof(list->drawn_info), "%s", list->info_buf);
+        snprintf(list->drawn_filter, sizeof(list->drawn_filter), "%s", filter_line);
+        list->drawn_command = list->current_command;
+    }
+
+    list->drawn_from = idx_from;
+    list->drawn_selected = list->selected;
+
+    if (list->filter_editing) {
+        // Right past the query.
+        size_t x = 1 + filter_query_width(list);
+        move(0, x < list->width ? (int) x : (int) list->width - 1);
+    } else {
+        move(size ? list->selected - idx_from + 1 : 1, 0);
+    }
+    int64_t started = trace_begin();
+    refresh();
+    trace_end("refresh", started);
+}
+
+// Writes 'x' followed by a newline in text mode, or as a varint in binary mode.
+static int say_uint(List *list, uint64_t x, int *caught_signal)
+{
+    char buf[32];
+    size_t n;
+    if (list->binary) {
+        n = varint_encode(buf, x);
+    } else {
+        n = print_uint(buf, x);
+        buf[n++] = '\n';
+    }
+    return say_bytes(list, buf, n, caught_signal);
+}
+
+// Writes the index of the selected entry and, if the list is keyed, its key: followed by a newline in
+// text mode, or as a cell in binary mode. With several sources, the index is preceded by the number
+// of the source whose segment has the entry, and is the index in that segment.
+static int say_selected(List *list, int *caught_signal)
+{
+    uint64_t pos = list_selected_position(list);
+    if (list->nsources > 1) {
+        size_t i = 0;
+        while (i < list->nsources && pos >= list->sources[i].size) {
+            pos -= list->sources[i].size;
+            ++i;
+        }
+        if (i == list->nsources) {
+            // The list is empty.
+            i = 0;
+            pos = 0;
+        }
+        if (say_uint(list, i, caught_signal) < 0) {
+            return -1;
+        }
+    }
+    if (say_uint(list, pos, caught_signal) < 0) {
+        return -1;
+    }
+    if (!list->keyed) {
+        return 0;
+    }
+    ListEntry *entry = list_selected_entry(list);
+    const char *key = entry ? entry->key : "";
+    size_t nkey = entry ? entry->nkey : 0;
+    if (list->binary) {
+        if (say_uint(list, nkey, caught_signal) < 0) {
+            return -1;
+        }
+        return say_bytes(list, key, nkey, caught_signal);
+    }
+    if (say_bytes(list, key, nkey, caught_signal) < 0) {
+        return -1;
+    }
+    return say(list, "\n", caught_signal);
+}
+
+// Writes an acknowledgement: 'ok' alone, or, with 'ack_timing', followed by the time it took to read
+// and parse the pack, to apply it, and to render it (zero if not waited for), in microseconds.
+static int say_ack(List *list, const PackTiming *t, int64_t render_ns, int *caught_signal)
+{
+    if (global_tracer) {
+        histogram_add(&global_tracer->pack_to_ack, pacer_now() - t->arrived);
+    }
+    if (!list->ack_timing) {
+        return say_tag(list, "ok\n", 'o', caught_signal);
+    }
+    uint64_t parse_us = (t->total - t->apply) / 1000;
+    uint64_t apply_us = t->apply / 1000;
+    uint64_t render_us = render_ns / 1000;
+    char buf[128];
+    size_t n;
+    if (list->binary) {
+        buf[0] = 'o';
+        n = 1;
+        n += varint_encode(buf + n, parse_us);
+        n += varint_encode(buf + n, apply_us);
+        n += varint_encode(buf + n, render_us);
+    } else {
+        n = snprintf(
+            buf, sizeof(buf), "ok %" PRIu64 " %" PRIu64 " %" PRIu64 "\n",
+            parse_us, apply_us, render_us);
+    }
+    return say_bytes(list, buf, n, caught_signal);
+}
+
+// Called once a pack has been applied in full; acknowledges it according to the policy.
+static int ack_pack(List *list, int *caught_signal)
+{
+    PackTiming t = list->src->pack_timing;
+    list->src->pack_timing = (PackTiming) {0};
+
+    switch (list->ack_policy) {
+    case ACK_EVERY:
+        return say_ack(list, &t, 0, caught_signal);
+
+    case ACK_NONE:
+        if (global_tracer) {
+            histogram_add(&global_tracer->pack_to_ack, pacer_now() - t.arrived);
+        }
+        return 0;
+
+    case ACK_BATCH:
+        if (!list->src->nbatched) {
+            list->src->batch_timing.arrived = t.arrived;
+        }
+        list->src->batch_timing.total += t.total;
+        list->src->batch_timing.apply += t.apply;
+        if (++list->src->nbatched < list->ack_batch) {
+            return 0;
+        }
+        list->src->nbatched = 0;
+        t = list->src->batch_timing;
+        list->src->batch_timing = (PackTiming) {0};
+        return say_ack(list, &t, 0, caught_signal);
+
+    case ACK_AFTER_RENDER:
+        if (list->src->nunacked == list->src->cunacked) {
+            list->src->unacked = x2realloc_or_die(list->src->unacked, &list->src->cunacked, sizeof(PackTiming));
+        }
+        list->src->unacked[list->src->nunacked++] = t;
+        return 0;
+    }
+    return 0;
+}
+
+// Acknowledges the packs held back until a frame showing them has been rendered, which took
+// 'render_ns' nanoseconds.
+static int flush_acks(List *list, int64_t render_ns, int *caught_signal)
+{
+    for (size_t k = 0; k < list->nsources; ++k) {
+        Source *src = &list->sources[k];
+        list->src = src;
+        size_t n = src->nunacked;
+        src->nunacked = 0;
+        for (size_t i = 0; i < n; ++i) {
+            if (say_ack(list, &src->unacked[i], render_ns, caught_signal) < 0) {
+                return -1;
+            }
+        }
+    }
+    return 0;
 }
 
 static void print_result(List *list, int *exitcode)
 {
     int caught_signal = 0;
-    if (say(list, "result\n", &caught_signal) < 0) {
+    // The result comes after the acknowledgements of the packs already applied.
+    if (flush_acks(list, 0, &caught_signal) < 0) {
         goto error;
     }
-    if (say_uint(list, list->selected, &caught_signal) < 0) {
+    list->src = list->sources;
+    if (say_tag(list, "result\n", 'r', &caught_signal) < 0) {
+        goto error;
+    }
+    if (say_selected(list, &caught_signal) < 0) {
         goto error;
     }
     return;
@@ -347,6 +2082,8 @@ static inline bool is_valid_command_ch(int c)
     return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
 }
 
+// Returns -1 if there is no such command or it cannot be run now (the info message is set), 1 if it
+// has been held back until the pack being applied is complete, or 0 otherwise.
 static int print_result_cc(List *list, int *exitcode)
 {
     char spelling = list->current_command;
@@ -364,25 +2101,33 @@ static int print_result_cc(List *list, int *exitcode)
             "No such custom command: '%c'", spelling);
         return -1;
     }
-    if (cc->with_index && list->size == 0) {
-        if (list->size == 0) {
+    if (cc->with_index && list_nvisible(list) == 0) {
+        if (list_nvisible(list) == 0) {
             snprintf(
                 list->info_buf, sizeof(list->info_buf),
                 "The list is empty");
             return -1;
         }
     }
+    if (list_in_pack(list)) {
+        list->exit_pending = spelling;
+        return 1;
+    }
 
     int caught_signal = 0;
-    if (say(list, "custom\n", &caught_signal) < 0) {
+    if (flush_acks(list, 0, &caught_signal) < 0) {
+        goto error;
+    }
+    list->src = list->sources;
+    if (say_tag(list, "custom\n", 'c', &caught_signal) < 0) {
         goto error;
     }
     char cmd[3] = {spelling, '\n', '\0'};
-    if (say(list, cmd, &caught_signal) < 0) {
+    if (say_tag(list, cmd, spelling, &caught_signal) < 0) {
         goto error;
     }
     if (cc->with_index) {
-        if (say_uint(list, list->selected, &caught_signal) < 0) {
+        if (say_selected(list, &caught_signal) < 0) {
             goto error;
         }
     }
@@ -392,8 +2137,55 @@ error:
     return 0;
 }
 
+// Tells the user that the result is held back until the packs being applied are complete.
+static void describe_exit_pending(List *list)
+{
+    uint64_t left = 0;
+    for (size_t i = 0; i < list->nsources; ++i) {
+        left += list->sources[i].in_pack ? list->sources[i].pack_left : 0;
+    }
+    snprintf(
+        list->info_buf, sizeof(list->info_buf),
+        "Waiting for the rest of the pack (%" PRIu64 " commands)...", left);
+}
+
+// Writes what has been held back until the pack is complete. Returns whether cmenu should quit.
+static bool finish_exit_pending(List *list, int *exitcode)
+{
+    char c = list->exit_pending;
+    list->exit_pending = '\0';
+    list->info_buf[0] = '\0';
+    if (c != '\n') {
+        list->current_command = c;
+        int r = print_result_cc(list, exitcode);
+        list->current_command = '\0';
+        return r >= 0 && (!list->persistent || *exitcode);
+    }
+    if (!list_nvisible(list)) {
+        snprintf(list->info_buf, sizeof(list->info_buf), "The list is empty");
+        return false;
+    }
+    print_result(list, exitcode);
+    return !list->persistent || *exitcode;
+}
+
 #define ctrl(x) ((x) & 0x1F)
 
+static void describe_sort(List *list)
+{
+    if (!list->sorting) {
+        snprintf(list->info_buf, sizeof(list->info_buf), "Not sorted");
+        return;
+    }
+    const ListCell *title = &list->headers[list->sort_col];
+    snprintf(
+        list->info_buf, sizeof(list->info_buf),
+        "Sorted by column %zu '%.*s' (%s, %s)",
+        list->sort_col + 1, (int) title->nraw, title->raw,
+        list->sort_numeric ? "numbers" : "strings",
+        list->sort_desc ? "descending" : "ascending");
+}
+
 static int handle_input(List *list, bool *requery_size, int *exitcode)
 {
     int c = getch();
@@ -425,11 +2217,18 @@ static int handle_input(List *list, bool *requery_size, int *exitcode)
                 if (list->current_command == ':') {
                     list->current_command = '\0';
                 } else {
-                    if (print_result_cc(list, exitcode) < 0) {
+                    int r = print_result_cc(list, exitcode);
+                    if (r < 0) {
+                        list->current_command = '\0';
+                        return 0;
+                    }
+                    if (r > 0) {
                         list->current_command = '\0';
+                        describe_exit_pending(list);
                         return 0;
                     }
-                    return -1;
+                    list->current_command = '\0';
+                    return list->persistent && !*exitcode ? 0 : -1;
                 }
                 return 0;
 
@@ -447,13 +2246,62 @@ static int handle_input(List *list, bool *requery_size, int *exitcode)
         }
     }
 
+    if (list->filter_editing) {
+        switch (c) {
+        case ctrl('['):
+            list->filter_editing = false;
+            if (list_filtering(list)) {
+                list->nfilter_query = 0;
+                list_filter_restart(list, false);
+            }
+            return 0;
+
+        case '\n':
+        case '\r':
+        case KEY_ENTER:
+            list->filter_editing = false;
+            return 0;
+
+        case 127:
+        case '\b':
+        case KEY_BACKSPACE:
+            if (!list_filtering(list)) {
+                list->filter_editing = false;
+                return 0;
+            }
+            // Remove the last character, which might take more than one byte.
+            do {
+                --list->nfilter_query;
+            } while (list->nfilter_query && (list->filter_query[list->nfilter_query] & 0xC0) == 0x80);
+            list_filter_restart(list, false);
+            return 0;
+
+        default:
+            if (c >= 0x20 && c <= 0xFF) {
+                if (list->nfilter_query < sizeof(list->filter_query)) {
+                    list->filter_query[list->nfilter_query++] = c;
+                    list_filter_restart(list, true);
+                }
+                return 0;
+            }
+            // Other keys (such as arrows) work as usual.
+            break;
+        }
+    }
+
+    if ((list->virtual || list->from_file) && (c == '/' || c == 's' || c == 'S')) {
+        // The rows are not entries that could be matched or moved around.
+        snprintf(list->info_buf, sizeof(list->info_buf), "Not available for a virtual list or a file");
+        return 0;
+    }
+
     switch (c) {
     case KEY_UP:
     case 'k':
     case ctrl('p'):
         --list->selected;
         if (list->selected == (size_t) -1) {
-            list->selected = list->size ? list->size - 1 : 0;
+            list->selected = list_nvisible(list) ? list_nvisible(list) - 1 : 0;
         }
         return 0;
 
@@ -461,7 +2309,7 @@ static int handle_input(List *list, bool *requery_size, int *exitcode)
     case 'j':
     case ctrl('n'):
         ++list->selected;
-        if (list->selected >= list->size) {
+        if (list->selected >= list_nvisible(list)) {
             list->selected = 0;
         }
         return 0;
@@ -473,13 +2321,47 @@ static int handle_input(List *list, bool *requery_size, int *exitcode)
 
     case KEY_END:
     case 'G':
-        list->selected = list->size ? list->size - 1 : 0;
+        list->selected = list_nvisible(list) ? list_nvisible(list) - 1 : 0;
         return 0;
 
     case ctrl('g'):
+        (void) 0;
+        char extra_info[128] = "";
+        if (list->indexed || list->keyed) {
+            size_t nextra = 0;
+            if (list->indexed) {
+                nextra += snprintf(
+                    extra_info, sizeof(extra_info),
+                    " --- index: %zu KiB", trigram_index_memory(&list->index) / 1024);
+            }
+            if (list->keyed) {
+                snprintf(
+                    extra_info + nextra, sizeof(extra_info) - nextra,
+                    " --- keys: %zu KiB", key_map_memory(&list->keys) / 1024);
+            }
+        } else if (list->virtual) {
+            snprintf(
+                extra_info, sizeof(extra_info),
+                " --- %zu windows cached, %" PRIu64 " requests for %" PRIu64 " rows",
+                list->nwindows, list->nrequests, list->nrequested_rows);
+        } else if (list->from_file) {
+            snprintf(
+                extra_info, sizeof(extra_info),
+                " --- file: %zu MiB%s", list->file.size / (1024 * 1024),
+                list->file_scanning ? ", still scanning" : "");
+        }
+        uint64_t nreads = 0;
+        uint64_t nbytes = 0;
+        for (size_t i = 0; i < list->nsources; ++i) {
+            nreads += list->sources[i].infile.nreads;
+            nbytes += list->sources[i].infile.nbytes;
+        }
         snprintf(
             list->info_buf, sizeof(list->info_buf),
-            "--- %zu/%zu --- (ESC to hide this)", list->selected + 1, list->size);
+            "--- %zu/%zu --- read(): %" PRIu64 " calls, %" PRIu64 " bytes"
+            " --- %" PRIu64 " frames for %" PRIu64 " events%s --- (ESC to hide this)",
+            list->selected + 1, list_nvisible(list), nreads, nbytes,
+            list->pacer.nframes, list->pacer.nevents, extra_info);
         return 0;
 
     case ctrl('['):
@@ -513,6 +2395,29 @@ static int handle_input(List *list, bool *requery_size, int *exitcode)
         list->current_command = ':';
         return 0;
 
+    case '/':
+        list->info_buf[0] = '\0';
+        list->filter_editing = true;
+        return 0;
+
+    case 's':
+        if (!list->sorting) {
+            list_set_sort(list, true, 0, list->sort_numeric, list->sort_desc);
+        } else if (list->sort_col + 1 < list->ncols) {
+            list_set_sort(list, true, list->sort_col + 1, list->sort_numeric, list->sort_desc);
+        } else {
+            list_set_sort(list, false, 0, list->sort_numeric, list->sort_desc);
+        }
+        describe_sort(list);
+        return 0;
+
+    case 'S':
+        if (list->sorting) {
+            list_set_sort(list, true, list->sort_col, list->sort_numeric, !list->sort_desc);
+        }
+        describe_sort(list);
+        return 0;
+
     case KEY_RESIZE:
         *requery_size = true;
         return 0;
@@ -525,9 +2430,14 @@ static int handle_input(List *list, bool *requery_size, int *exitcode)
 
     default:
         if (c == '\n' || c == '\r' || c == KEY_ENTER) {
-            if (list->size) {
+            if (list_nvisible(list)) {
+                if (list_in_pack(list)) {
+                    list->exit_pending = '\n';
+                    describe_exit_pending(list);
+                    return 0;
+                }
                 print_result(list, exitcode);
-                return -1;
+                return list->persistent && !*exitcode ? 0 : -1;
             }
             return 0;
         } else {
@@ -536,9 +2446,9 @@ static int handle_input(List *list, bool *requery_size, int *exitcode)
     }
 }
 
-static inline TruncatedText truncated_text_from_cstr(const char *s)
+static inline TruncatedText truncated_text_from_span(const char *s, size_t ns)
 {
-    wchar_t *ws = decode_copy(s);
+    wchar_t *ws = decode_copy(s, ns);
     if (!ws) {
         const wchar_t wmsg[] = L"(encoding error)";
         ws = memdup_or_die(wmsg, sizeof(wmsg));
@@ -548,58 +2458,396 @@ static inline TruncatedText truncated_text_from_cstr(const char *s)
         nws = INT_MAX;
         ws[nws] = L'\0';
     }
-    return (TruncatedText) {
+    TruncatedText t = {
         .s = ws,
         .n = nws,
+        .widths = malloc_or_die(nws, sizeof(uint32_t)),
     };
+    if (truncated_text_prepare(&t, t.widths)) {
+        free(t.widths);
+        t.widths = NULL;
+    }
+    return t;
 }
 
-static char *read_line_from_infile(List *list, int *caught_signal)
+enum {
+    CMD_APPEND    = '+',
+    CMD_INSERT    = 'I',
+    CMD_SET       = '=',
+    CMD_SET_RANGE = 'R',
+    CMD_DEL       = '-',
+    CMD_DEL_RANGE = 'D',
+    CMD_TRUNCATE  = 't',
+    CMD_CLEAR     = 'x',
+    CMD_UPSERT    = 'k',
+    CMD_DEL_KEY   = 'd',
+    CMD_COUNT     = 'v',
+    CMD_QUIT      = 'Q',
+};
+
+typedef struct {
+    // One of the CMD_* values; in binary mode, this is also the opcode byte.
+    char op;
+    // Index, or start of the range.
+    uint64_t a;
+    // Size of the range.
+    uint64_t b;
+    // The key, for keyed commands. Valid until the next read.
+    const char *key;
+    size_t nkey;
+} Command;
+
+// Returns a line (without the newline character) that points into the input buffer and is valid
+// until the next read. On EOF, returns NULL with errno set to 0.
+static char *read_raw_line_from_infile(List *list, size_t *nline, int *caught_signal)
 {
-    ssize_t r = bio_read_line(&list->infile, &list->infile_buf, &list->infile_nbuf, caught_signal);
+    char *line;
+    ssize_t r = bio_read_line(&list->src->infile, &line, caught_signal);
     if (r < 0) {
         return NULL;
     }
-    char *line = list->infile_buf;
     if (r == 0 || line[r - 1] != '\n') {
         errno = 0;
         return NULL;
     }
-    line[r - 1] = '\0';
+    *nline = r - 1;
     return line;
 }
 
-static int read_entry_from_infile(List *list, ListEntry *entry, int *caught_signal)
+// Like 'read_raw_line_from_infile()', but returns a null-terminated copy of the line that is valid
+// until the next call.
+static char *read_line_from_infile(List *list, size_t *nline, int *caught_signal)
 {
-    size_t ncols = list->ncols;
-    TruncatedText *cols = malloc_or_die(sizeof(TruncatedText), ncols);
-    size_t col_i = 0;
-    for (; col_i < ncols; ++col_i) {
-        char *line = read_line_from_infile(list, caught_signal);
+    size_t n;
+    char *line = read_raw_line_from_infile(list, &n, caught_signal);
+    if (!line) {
+        return NULL;
+    }
+    while (list->scratch_nline <= n) {
+        list->scratch_line = x2realloc_or_die(list->scratch_line, &list->scratch_nline, sizeof(char));
+    }
+    memcpy(list->scratch_line, line, n);
+    list->scratch_line[n] = '\0';
+    if (nline) {
+        *nline = n;
+    }
+    return list->scratch_line;
+}
+
+// Returns 1 on success, 0 on EOF (before the first byte), or -1 on error (the error message is set).
+static int read_byte_from_infile(List *list, char *out, int *caught_signal)
+{
+    char *p;
+    ssize_t r = bio_read_exact(&list->src->infile, &p, 1, caught_signal);
+    if (r < 0) {
+        errmsgf("Cannot read from input fd: %s\n", strerror(errno));
+        return -1;
+    }
+    if (r) {
+        *out = *p;
+    }
+    return r;
+}
+
+static int read_varint_from_infile(List *list, uint64_t *out, const char *what, int *caught_signal)
+{
+    char buf[VARINT_MAX];
+    for (size_t i = 0; i < VARINT_MAX; ++i) {
+        int r = read_byte_from_infile(list, &buf[i], caught_signal);
+        if (r < 0) {
+            return -1;
+        }
+        if (r == 0) {
+            errmsgf("Expected %s, got EOF.\n", what);
+            return -1;
+        }
+        r = varint_decode(buf, i + 1, out);
+        if (r > 0) {
+            return 0;
+        }
+        if (r < 0) {
+            break;
+        }
+    }
+    errmsgf("Invalid %s (varint overflow).\n", what);
+    return -1;
+}
+
+// Returns a pointer to the cell's bytes, which points into the input buffer and is valid until the
+// next read, or NULL on error (the error message is set).
+static char *read_cell_from_infile(List *list, size_t *ncell, int *caught_signal)
+{
+    if (!list->binary) {
+        char *line = read_raw_line_from_infile(list, ncell, caught_signal);
         if (!line) {
             if (errno == 0) {
-                errmsgf("Unterminated '+' command (got EOF).\n");
-                goto fail;
+                errmsgf("Unterminated command (got EOF).\n");
             } else {
                 errmsgf("Cannot read line from input fd: %s\n", strerror(errno));
-                goto fail;
             }
         }
-        cols[col_i] = truncated_text_from_cstr(line);
+        return line;
+    }
+
+    uint64_t n;
+    if (read_varint_from_infile(list, &n, "cell length", caught_signal) < 0) {
+        return NULL;
+    }
+    if (n >= (uint64_t) SSIZE_MAX) {
+        errmsgf("Cell length is too large.\n");
+        return NULL;
+    }
+    char *cell;
+    ssize_t r = bio_read_exact(&list->src->infile, &cell, n, caught_signal);
+    if (r < 0) {
+        errmsgf("Cannot read from input fd: %s\n", strerror(errno));
+        return NULL;
+    }
+    if ((uint64_t) r != n) {
+        errmsgf("Unterminated command (got EOF).\n");
+        return NULL;
+    }
+    *ncell = n;
+    return cell;
+}
+
+// Appends 's' and a null byte to the scratch space, which has 'nraw' bytes in use.
+static void scratch_raw_append(List *list, size_t *nraw, const char *s, size_t ns)
+{
+    while (list->scratch_nraw - *nraw <= ns) {
+        list->scratch_raw = x2realloc_or_die(list->scratch_raw, &list->scratch_nraw, sizeof(char));
+    }
+    memcpy(list->scratch_raw + *nraw, s, ns);
+    list->scratch_raw[*nraw + ns] = '\0';
+    *nraw += ns + 1;
+}
+
+// Reads the columns of an entry and allocates it, together with its key (if 'key' is not NULL) and
+// the raw text of the columns, as a single arena block. Decoding is deferred until the entry is drawn.
+static ListEntry *read_entry_from_infile(List *list, const char *key, size_t nkey, int *caught_signal)
+{
+    size_t ncols = list->ncols;
+    size_t *offsets = list->scratch_offsets;
+    size_t nraw = 0;
+    // The key is only valid until the next read, so it has to be copied before the cells are read.
+    if (key) {
+        scratch_raw_append(list, &nraw, key, nkey);
+    }
+    for (size_t i = 0; i < ncols; ++i) {
+        size_t ncell;
+        char *cell = read_cell_from_infile(list, &ncell, caught_signal);
+        if (!cell) {
+            return NULL;
+        }
+        offsets[i] = nraw;
+        scratch_raw_append(list, &nraw, cell, ncell);
+    }
+
+    size_t nbytes = sizeof(ListEntry) + ncols * sizeof(ListCell) + nraw;
+    ListEntry *entry = arena_alloc(&list->arena, nbytes);
+    ListCell *cols = (ListCell *) (entry + 1);
+    char *raw = (char *) (cols + ncols);
+
+    memcpy(raw, list->scratch_raw, nraw);
+    for (size_t i = 0; i < ncols; ++i) {
+        size_t end = i + 1 < ncols ? offsets[i + 1] : nraw;
+        cols[i] = (ListCell) {
+            .raw = raw + offsets[i],
+            .nraw = end - offsets[i] - 1,
+        };
+    }
+    entry->nbytes = nbytes;
+    entry->index_id = 0;
+    entry->measured = false;
+    entry->key = key ? raw : NULL;
+    entry->nkey = nkey;
+    entry->cols = cols;
+    return entry;
+}
+
+// Reads the next entry of the '==' command being applied and stores it in place of the entry at
+// 'range_next' of the segment of the source; the arena hands the slot of the old entry right back.
+// Entries past the end of the segment are read and thrown away.
+static int replace_next_from_infile(List *list, int *caught_signal)
+{
+    ListEntry *entry = read_entry_from_infile(list, NULL, 0, caught_signal);
+    if (!entry) {
+        return -1;
+    }
+    Source *src = list->src;
+    uint64_t idx = src->range_next++;
+    --src->range_left;
+
+    int64_t started = list->ack_timing ? pacer_now() : 0;
+    if (list->virtual) {
+        list_virtual_store(list, idx, entry);
+    } else if (idx < src->size) {
+        idx += list_source_base(list, src);
+        list_replace(list, idx, itree_at(&list->entries, idx), entry);
+    } else {
+        list_entry_free(list, entry);
+    }
+    if (list->ack_timing) {
+        src->pack_timing.apply += pacer_now() - started;
     }
-    *entry = (ListEntry) {cols};
     return 0;
-fail:
-    for (size_t i = 0; i < col_i; ++i) {
-        free(cols[i].s);
+}
+
+// Parses "A B", where A and B are unsigned integers.
+static int parse_uint_pair(const char *s, int64_t *a, int64_t *b, const char **err)
+{
+    const char *space = strchr(s, ' ');
+    if (!space) {
+        *err = "expected two space-separated numbers";
+        return -1;
     }
-    free(cols);
-    return -1;
+    if ((*a = parse_uint(s, space - s, INT64_MAX)) < 0) {
+        *err = parse_uint_strerror(*a);
+        return -1;
+    }
+    const char *t = space + 1;
+    if ((*b = parse_uint(t, strlen(t), INT64_MAX)) < 0) {
+        *err = parse_uint_strerror(*b);
+        return -1;
+    }
+    return 0;
 }
 
-static int handle_infile_command(List *list, int *caught_signal)
+static int parse_text_uint(const char *v, uint64_t *out, const char *what)
+{
+    int64_t r = parse_uint(v, strlen(v), INT64_MAX);
+    if (r < 0) {
+        errmsgf("Cannot parse %s: %s\n", what, parse_uint_strerror(r));
+        return -1;
+    }
+    *out = r;
+    return 0;
+}
+
+static int parse_text_uint_pair(const char *v, Command *cmd, const char *what)
+{
+    int64_t a;
+    int64_t b;
+    const char *err;
+    if (parse_uint_pair(v, &a, &b, &err) < 0) {
+        errmsgf("Cannot parse %s: %s\n", what, err);
+        return -1;
+    }
+    cmd->a = a;
+    cmd->b = b;
+    return 0;
+}
+
+static int parse_text_command(const char *line, size_t nline, Command *cmd)
+{
+    *cmd = (Command) {0};
+
+    if (line[0] == '+' && line[1] == '\0') {
+        cmd->op = CMD_APPEND;
+        return 0;
+
+    } else if (line[0] == '+' && line[1] == ' ') {
+        cmd->op = CMD_INSERT;
+        return parse_text_uint(line + 2, &cmd->a, "'+' index");
+
+    } else if (line[0] == '=' && line[1] == ' ') {
+        cmd->op = CMD_SET;
+        return parse_text_uint(line + 2, &cmd->a, "'=' index");
+
+    } else if (line[0] == '=' && line[1] == '=' && line[2] == ' ') {
+        cmd->op = CMD_SET_RANGE;
+        return parse_text_uint_pair(line + 3, cmd, "'==' range");
+
+    } else if (line[0] == '-' && line[1] == ' ') {
+        cmd->op = CMD_DEL;
+        return parse_text_uint(line + 2, &cmd->a, "'-' index");
+
+    } else if (line[0] == '-' && line[1] == '-' && line[2] == ' ') {
+        cmd->op = CMD_DEL_RANGE;
+        return parse_text_uint_pair(line + 3, cmd, "'--' range");
+
+    } else if (line[0] == 't' && line[1] == ' ') {
+        cmd->op = CMD_TRUNCATE;
+        return parse_text_uint(line + 2, &cmd->a, "'t' number");
+
+    } else if (line[0] == 'v' && line[1] == ' ') {
+        cmd->op = CMD_COUNT;
+        return parse_text_uint(line + 2, &cmd->a, "'v' number");
+
+    } else if (line[0] == 'x' && line[1] == '\0') {
+        cmd->op = CMD_CLEAR;
+        return 0;
+
+    } else if (strcmp(line, "quit") == 0) {
+        cmd->op = CMD_QUIT;
+        return 0;
+
+    } else if ((line[0] == 'k' || line[0] == 'd') && line[1] == ' ') {
+        cmd->op = line[0] == 'k' ? CMD_UPSERT : CMD_DEL_KEY;
+        cmd->key = line + 2;
+        cmd->nkey = nline - 2;
+        return 0;
+
+    } else {
+        errmsgf("Invalid command: %s\n", line);
+        return -1;
+    }
+}
+
+static int read_binary_command(List *list, Command *cmd, int *caught_signal)
+{
+    *cmd = (Command) {0};
+
+    int r = read_byte_from_infile(list, &cmd->op, caught_signal);
+    if (r < 0) {
+        return -1;
+    }
+    if (r == 0) {
+        errmsgf("Expected a command, got EOF.\n");
+        return -1;
+    }
+
+    switch (cmd->op) {
+    case CMD_APPEND:
+    case CMD_CLEAR:
+    case CMD_QUIT:
+        return 0;
+
+    case CMD_INSERT:
+    case CMD_SET:
+    case CMD_DEL:
+        return read_varint_from_infile(list, &cmd->a, "index", caught_signal);
+
+    case CMD_TRUNCATE:
+    case CMD_COUNT:
+        return read_varint_from_infile(list, &cmd->a, "number", caught_signal);
+
+    case CMD_SET_RANGE:
+    case CMD_DEL_RANGE:
+        if (read_varint_from_infile(list, &cmd->a, "range start", caught_signal) < 0) {
+            return -1;
+        }
+        return read_varint_from_infile(list, &cmd->b, "range size", caught_signal);
+
+    case CMD_UPSERT:
+    case CMD_DEL_KEY:
+        cmd->key = read_cell_from_infile(list, &cmd->nkey, caught_signal);
+        return cmd->key ? 0 : -1;
+
+    default:
+        errmsgf("Invalid command opcode: 0x%02x\n", (unsigned) (unsigned char) cmd->op);
+        return -1;
+    }
+}
+
+static int read_command_from_infile(List *list, Command *cmd, int *caught_signal)
 {
-    char *line = read_line_from_infile(list, caught_signal);
+    if (list->binary) {
+        return read_binary_command(list, cmd, caught_signal);
+    }
+
+    size_t nline;
+    char *line = read_line_from_infile(list, &nline, caught_signal);
     if (!line) {
         if (errno == 0) {
             errmsgf("Expected a command, got EOF.\n");
@@ -609,83 +2857,369 @@ static int handle_infile_command(List *list, int *caught_signal)
             return -1;
         }
     }
+    return parse_text_command(line, nline, cmd);
+}
+
+static int handle_infile_command(List *list, int *caught_signal)
+{
+    Command cmd;
+    if (read_command_from_infile(list, &cmd, caught_signal) < 0) {
+        return -1;
+    }
 
-    if (line[0] == '+' && line[1] == '\0') {
-        ListEntry entry;
-        if (read_entry_from_infile(list, &entry, caught_signal) < 0) {
+    // Keyed lists only get entries with keys; the commands that remove entries work either way.
+    bool keyed_op = cmd.op == CMD_UPSERT || cmd.op == CMD_DEL_KEY;
+    bool adding_op = cmd.op == CMD_APPEND || cmd.op == CMD_INSERT || cmd.op == CMD_SET || cmd.op == CMD_SET_RANGE;
+    if (keyed_op && !list->keyed) {
+        errmsgf("Command '%c' requires -keyed.\n", cmd.op);
+        return -1;
+    }
+    if (adding_op && list->keyed) {
+        errmsgf("Only 'k' can add or change entries with -keyed.\n");
+        return -1;
+    }
+    // Virtual lists only get their size and the rows that have been asked for.
+    bool virtual_op = cmd.op == CMD_COUNT || cmd.op == CMD_SET || cmd.op == CMD_SET_RANGE || cmd.op == CMD_CLEAR ||
+                      cmd.op == CMD_QUIT;
+    if (cmd.op == CMD_COUNT && !list->virtual) {
+        errmsgf("Command 'v' requires -virtual.\n");
+        return -1;
+    }
+    if (!virtual_op && list->virtual) {
+        errmsgf("Only '=', '==', 'v', 'x' and 'quit' can be used with -virtual.\n");
+        return -1;
+    }
+
+    ListEntry *entry = NULL;
+    bool with_entry = cmd.op == CMD_UPSERT || cmd.op == CMD_APPEND || cmd.op == CMD_INSERT || cmd.op == CMD_SET;
+    if (with_entry) {
+        entry = read_entry_from_infile(list, cmd.key, cmd.nkey, caught_signal);
+        if (!entry) {
             return -1;
         }
-        list_add(list, entry);
-        return 0;
+    }
 
-    } else if (line[0] == '=' && line[1] == ' ') {
-        const char *v = line + 2;
-        int64_t r = parse_uint(v, strlen(v), INT64_MAX);
-        if (r < 0) {
-            errmsgf("Cannot parse '=' index: %s\n", parse_uint_strerror(r));
+    // Counted only now that the command has been read in full, since it may be read again.
+    if (global_stats) {
+        ++global_stats->ncommands[cmd.op & 127];
+    }
+
+    int64_t started = list->ack_timing ? pacer_now() : 0;
+
+    // The indices are those of the segment of the source, which starts at 'base'.
+    Source *src = list->src;
+    uint64_t base = list_source_base(list, src);
+    uint64_t size_before = list_size(list);
+
+    switch (cmd.op) {
+    case CMD_UPSERT:
+        list_upsert(list, entry);
+        break;
+
+    case CMD_DEL_KEY:
+        list_del_key(list, cmd.key, cmd.nkey);
+        break;
+
+    case CMD_APPEND:
+    case CMD_INSERT:
+    case CMD_SET:
+        if (list->virtual) {
+            list_virtual_store(list, cmd.a, entry);
+        } else if (cmd.op == CMD_SET) {
+            if (cmd.a < src->size) {
+                list_set(list, base + cmd.a, entry);
+            } else {
+                list_entry_free(list, entry);
+            }
+        } else {
+            list_add(list, base + (cmd.op == CMD_APPEND || cmd.a > src->size ? src->size : cmd.a), entry);
+        }
+        break;
+
+    case CMD_SET_RANGE:
+        // The entries are read one by one (see 'handle_infile_step()').
+        src->range_next = cmd.a;
+        src->range_left = cmd.b;
+        break;
+
+    case CMD_DEL:
+        if (cmd.a < src->size) {
+            list_del(list, base + cmd.a);
+        }
+        break;
+
+    case CMD_DEL_RANGE:
+        if (cmd.a < src->size) {
+            list_del_range(list, base + cmd.a, cmd.b < src->size - cmd.a ? cmd.b : src->size - cmd.a);
+        }
+        break;
+
+    case CMD_TRUNCATE:
+        if (cmd.a < src->size) {
+            list_del_range(list, base + cmd.a, src->size - cmd.a);
+        }
+        break;
+
+    case CMD_CLEAR:
+        if (list->nsources == 1) {
+            list_clear(list);
+        } else {
+            list_del_range(list, base, src->size);
+        }
+        break;
+
+    case CMD_COUNT:
+        list_virtual_set_count(list, cmd.a);
+        break;
+
+    case CMD_QUIT:
+        list->quit_pending = true;
+        break;
+    }
+    src->size += list_size(list) - size_before;
+
+    if (list->ack_timing) {
+        src->pack_timing.apply += pacer_now() - started;
+    }
+    return 0;
+}
+
+// Reads the header of a command pack. Returns 1 on success, 0 on EOF, or -1 on error.
+static int read_pack_header(List *list, uint64_t *ncommands, int *caught_signal)
+{
+    if (list->binary) {
+        char tag;
+        int r = read_byte_from_infile(list, &tag, caught_signal);
+        if (r <= 0) {
+            return r;
+        }
+        if (tag != 'n') {
+            errmsgf("Invalid pack tag (expected 'n'): 0x%02x\n", (unsigned) (unsigned char) tag);
+            return -1;
+        }
+        if (read_varint_from_infile(list, ncommands, "pack size", caught_signal) < 0) {
             return -1;
         }
-        ListEntry entry;
-        if (read_entry_from_infile(list, &entry, caught_signal) < 0) {
+        return 1;
+    }
+
+    char *line = read_line_from_infile(list, NULL, caught_signal);
+    if (!line) {
+        if (errno == 0) {
+            return 0;
+        } else {
+            errmsgf("Cannot read line from input fd: %s\n", strerror(errno));
             return -1;
         }
-        list_set(list, r, entry);
-        return 0;
+    }
 
-    } else if (line[0] == '-' && line[1] == ' ') {
-        const char *v = line + 2;
-        int64_t r = parse_uint(v, strlen(v), INT64_MAX);
-        if (r < 0) {
-            errmsgf("Cannot parse '-' index: %s\n", parse_uint_strerror(r));
+    if (line[0] == 'n' && line[1] == ' ') {
+        if (parse_text_uint(line + 2, ncommands, "'n' number") < 0) {
             return -1;
         }
-        list_del(list, r);
-        return 0;
-
-    } else if (line[0] == 'x' && line[1] == '\0') {
-        list_clear(list);
-        return 0;
+        return 1;
 
     } else {
-        errmsgf("Invalid command: %s\n", line);
+        errmsgf("Invalid line (expected 'n NUMBER'): %s\n", line);
         return -1;
     }
 }
 
-static int handle_infile_line(List *list, bool *close_infile, int *caught_signal)
+// Adds the time since the last call (or the start of the step) to the pack being applied.
+static void pack_clock(List *list)
 {
-    char *line = read_line_from_infile(list, caught_signal);
-    if (!line) {
-        if (errno == 0) {
+    int64_t now = pacer_now();
+    list->src->pack_timing.total += now - list->src->pack_clock;
+    list->src->pack_clock = now;
+}
+
+// Reads the header of the next pack, or applies the next command of the current pack, or the next
+// entry of the current '==' command. Acknowledges the pack once all of it has been applied. Nothing
+// is applied until everything it needs has been read.
+static int infile_advance(List *list, bool *close_infile, int *caught_signal)
+{
+    if (!list->src->in_pack) {
+        uint64_t n;
+        int r = read_pack_header(list, &n, caught_signal);
+        if (r < 0) {
+            return -1;
+        }
+        if (r == 0) {
             *close_infile = true;
             return 0;
-        } else {
-            errmsgf("Cannot read line from input fd: %s\n", strerror(errno));
+        }
+        list->src->in_pack = true;
+        list->src->pack_left = n;
+        if (global_tracer) {
+            list->src->pack_timing.arrived = pacer_now();
+        }
+    } else if (list->src->range_left) {
+        if (replace_next_from_infile(list, caught_signal) < 0) {
+            return -1;
+        }
+    } else {
+        if (handle_infile_command(list, caught_signal) < 0) {
             return -1;
         }
+        --list->src->pack_left;
     }
 
-    if (line[0] == 'n' && line[1] == ' ') {
-        const char *v = line + 2;
-        int64_t n = parse_uint(v, strlen(v), INT64_MAX);
-        if (n < 0) {
-            errmsgf("Cannot parse 'n' number: %s\n", parse_uint_strerror(n));
+    if (!list->src->pack_left && !list->src->range_left) {
+        list->src->in_pack = false;
+        if (global_stats) {
+            ++global_stats->npacks;
+        }
+        if (global_tracer) {
+            trace_record("pack", list->src->pack_timing.arrived, pacer_now(), TRACK_PACKS);
+        }
+        if (list->ack_timing) {
+            pack_clock(list);
+        }
+        if (ack_pack(list, caught_signal) < 0) {
             return -1;
         }
-        for (int64_t i = 0; i < n; ++i) {
-            if (handle_infile_command(list, caught_signal) < 0) {
-                return -1;
+    }
+    return 0;
+}
+
+enum {
+    // Commands (and entries of '==' commands) applied between checks for other events.
+    INFILE_STEP = 4096,
+};
+
+// Applies what can be read from the (non-blocking) input fd of 'src', but at most INFILE_STEP
+// commands, so that a large or slowly arriving pack holds up neither the keyboard, nor the screen, nor
+// the other sources. If a command has not arrived in full, it is read again from its start the next
+// time. Sets 'src->more' if it stopped because of the limit rather than for the lack of input.
+static int handle_infile_step(List *list, Source *src, bool *close_infile, int *caught_signal)
+{
+    list->src = src;
+    src->more = false;
+    if (list->ack_timing) {
+        src->pack_clock = pacer_now();
+    }
+    int r = 0;
+    size_t i = 0;
+    for (; i < INFILE_STEP; ++i) {
+        src->infile.would_block = false;
+        bio_mark(&src->infile);
+        if (infile_advance(list, close_infile, caught_signal) < 0) {
+            if (src->infile.would_block) {
+                bio_rewind(&src->infile);
+                global_errmsg[0] = '\0';
+            } else {
+                r = -1;
             }
+            break;
         }
-        if (say(list, "ok\n", caught_signal) < 0) {
-            return -1;
+        bio_unmark(&src->infile);
+        if (*close_infile) {
+            break;
         }
-        return 0;
+        // Between packs, wait for 'poll()' rather than try a read that most likely has nothing; and
+        // while a result or 'quit' waits for the packs of the other sources, do not start another one.
+        if (!src->in_pack
+            && (list->quit_pending || list->exit_pending || !bio_has_something(&src->infile))) {
+            break;
+        }
+    }
+    src->more = i == INFILE_STEP;
+    if (list->ack_timing && src->in_pack) {
+        pack_clock(list);
+    }
+    return r;
+}
 
-    } else {
-        errmsgf("Invalid line (expected 'n NUMBER'): %s\n", line);
-        return -1;
+// Writes the statistics as a single line of JSON. Returns -1 on error.
+static int write_stats(List *list, int fd, int64_t uptime)
+{
+    const Stats *st = global_stats;
+    char buf[2048];
+    size_t n = 0;
+#define APPEND(...) (n += snprintf(buf + n, sizeof(buf) - n, __VA_ARGS__))
+    APPEND("{\"uptime_ms\": %" PRIu64 ", \"packs\": %" PRIu64 ", \"commands\": {", (uint64_t) uptime / 1000000, st->npacks);
+    const char ops[] = {
+        CMD_APPEND, CMD_INSERT, CMD_SET, CMD_SET_RANGE, CMD_DEL, CMD_DEL_RANGE, CMD_TRUNCATE,
+        CMD_CLEAR, CMD_UPSERT, CMD_DEL_KEY, CMD_COUNT, CMD_QUIT,
+    };
+    for (size_t i = 0; i < sizeof(ops); ++i) {
+        APPEND("%s\"%c\": %" PRIu64, i ? ", " : "", ops[i], st->ncommands[(int) ops[i]]);
+    }
+    uint64_t nentries = list->virtual ? list->virtual_count : list->from_file ? list->file.nrecords : list_size(list);
+    uint64_t nreads = 0;
+    uint64_t nbytes = 0;
+    for (size_t i = 0; i < list->nsources; ++i) {
+        nreads += list->sources[i].infile.nreads;
+        nbytes += list->sources[i].infile.nbytes;
+    }
+    APPEND(
+        "}, \"read_calls\": %" PRIu64 ", \"read_bytes\": %" PRIu64 ", \"entries\": %" PRIu64
+        ", \"cells\": %" PRIu64 ", \"decoded_bytes\": %" PRIu64 ", \"allocs\": %" PRIu64
+        ", \"frames\": %" PRIu64,
+        nreads, nbytes, nentries, nentries * list->ncols, st->ndecoded,
+        st->nallocs, list->pacer.nframes);
+    const Histogram *hs[] = {&st->redraw, &st->key_to_frame};
+    const char *names[] = {"redraw_us", "key_to_frame_us"};
+    for (size_t i = 0; i < 2; ++i) {
+        APPEND(
+            ", \"%s\": {\"count\": %" PRIu64 ", \"p50\": %" PRIu64 ", \"p90\": %" PRIu64
+            ", \"p99\": %" PRIu64 ", \"max\": %" PRIu64 "}",
+            names[i], hs[i]->count, histogram_percentile(hs[i], 50), histogram_percentile(hs[i], 90),
+            histogram_percentile(hs[i], 99), (uint64_t) hs[i]->max / 1000);
+    }
+    APPEND("}\n");
+#undef APPEND
+
+    // The reader going away must not kill us, so SIGPIPE is held while writing and then discarded.
+    sigset_t pipe_set;
+    sigset_t old_set;
+    sigemptyset(&pipe_set);
+    sigaddset(&pipe_set, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &pipe_set, &old_set);
+    int r = 0;
+    for (size_t nwritten = 0; nwritten < n;) {
+        ssize_t w = write(fd, buf + nwritten, n - nwritten);
+        if (w >= 0) {
+            nwritten += w;
+        } else if (errno == EAGAIN && !nwritten) {
+            // The reader does not keep up: drop the report rather than hold up the UI. A report is
+            // shorter than PIPE_BUF, so a pipe takes it whole or not at all.
+            break;
+        } else if (errno == EAGAIN) {
+            // Finish the line, so that the reader does not get half of it.
+            struct pollfd pfd = {.fd = fd, .events = POLLOUT};
+            poll(&pfd, 1, -1);
+        } else if (errno != EINTR) {
+            r = -1;
+            break;
+        }
     }
+    if (r < 0 && errno == EPIPE) {
+        int saved = errno;
+        struct timespec zero = {0};
+        sigtimedwait(&pipe_set, NULL, &zero);
+        errno = saved;
+    }
+    pthread_sigmask(SIG_SETMASK, &old_set, NULL);
+    return r;
+}
+
+// Set on SIGUSR1: the trace is written out at the next turn of the main loop.
+static volatile sig_atomic_t trace_requested;
+
+static void handle_sigusr1(int sig)
+{
+    (void) sig;
+    trace_requested = 1;
+}
+
+// Set on SIGUSR2: a snapshot is saved once the pack being applied is complete.
+static volatile sig_atomic_t snapshot_requested;
+
+static void handle_sigusr2(int sig)
+{
+    (void) sig;
+    snapshot_requested = 1;
 }
 
 static int reset_std_fds(void)
@@ -751,17 +3285,61 @@ static inline void string_vec_push(StringVec *sv, const char *s)
     sv->data[sv->size++] = s;
 }
 
+// Sets up the poll entries of the sources: a source is not read while the snapshot is being loaded,
+// once it has been closed, or, while a result or 'quit' is waiting for the packs of the other
+// sources, between its packs. Returns whether any of the sources that can be read has more input
+// to apply right away.
+static bool poll_sources(List *list, struct pollfd *pfds)
+{
+    bool more = false;
+    for (size_t i = 0; i < list->nsources; ++i) {
+        Source *src = &list->sources[i];
+        bool paused = list->snapshot_loading
+            || ((list->exit_pending || list->quit_pending) && !src->in_pack);
+        pfds[i] = (struct pollfd) {.fd = paused ? -1 : src->infile.fd, .events = POLLIN};
+        more = more || (pfds[i].fd >= 0 && src->more);
+    }
+    return more;
+}
+
 int main(int argc, char **argv)
 {
     setlocale(LC_ALL, "");
+    utf8_init();
 
     StringVec column_args = string_vec_new();
     StringVec command_args = string_vec_new();
     RawStyle style_header = {.a = A_BOLD, .fc = COLOR_WHITE, .bc = COLOR_GREEN};
     RawStyle style_hi     = {.a = 0,      .fc = COLOR_WHITE, .bc = COLOR_BLUE};
     RawStyle style_entry  = {.a = 0,      .fc = -1,          .bc = -1};
-    int infd = -1;
-    int outfd = -1;
+    // One source per '-infd=' and '-outfd=' pair (see 'List::sources').
+    int *infds = NULL;
+    size_t ninfds = 0;
+    size_t cinfds = 0;
+    int *outfds = NULL;
+    size_t noutfds = 0;
+    size_t coutfds = 0;
+    bool binary = false;
+    bool indexed = false;
+    bool keyed = false;
+    bool virtual = false;
+    bool persistent = false;
+    AckPolicy ack_policy = ACK_EVERY;
+    uint64_t ack_batch = 1;
+    bool ack_timing = false;
+    int stats_fd = -1;
+    uint32_t stats_interval_ms = 1000;
+    const char *trace_path = NULL;
+    const char *save_snapshot_path = NULL;
+    const char *load_snapshot_path = NULL;
+    const char *file_path = NULL;
+    char file_sep = '\n';
+    uint32_t virtual_cache = 16 * 1024;
+    const char *sort_arg = NULL;
+    uint32_t max_fps = 60;
+    uint32_t frame_budget_ms = 16;
+    long nprocessors = sysconf(_SC_NPROCESSORS_ONLN);
+    uint32_t filter_nthreads = nprocessors > 0 ? nprocessors : 1;
 
     for (int i = 1; i < argc; ++i) {
         const char *arg = argv[i];
@@ -792,43 +3370,227 @@ int main(int argc, char **argv)
             string_vec_push(&column_args, v);
 
         } else if ((v = strfollow(arg, "-infd="))) {
-            infd = parse_uint(v, strlen(v), INT_MAX);
+            int infd = parse_uint(v, strlen(v), INT_MAX);
             if (infd < 0) {
                 fprintf(stderr, "Invalid -infd= argument: %s.\n", parse_uint_strerror(infd));
                 return 2;
             }
+            if (ninfds == cinfds) {
+                infds = x2realloc_or_die(infds, &cinfds, sizeof(int));
+            }
+            infds[ninfds++] = infd;
 
         } else if ((v = strfollow(arg, "-outfd="))) {
-            outfd = parse_uint(v, strlen(v), INT_MAX);
+            int outfd = parse_uint(v, strlen(v), INT_MAX);
             if (outfd < 0) {
                 fprintf(stderr, "Invalid -outfd= argument: %s.\n", parse_uint_strerror(outfd));
                 return 2;
             }
+            if (noutfds == coutfds) {
+                outfds = x2realloc_or_die(outfds, &coutfds, sizeof(int));
+            }
+            outfds[noutfds++] = outfd;
 
         } else if ((v = strfollow(arg, "-command="))) {
             string_vec_push(&command_args, v);
 
+        } else if ((v = strfollow(arg, "-protocol="))) {
+            if (strcmp(v, "text") == 0) {
+                binary = false;
+            } else if (strcmp(v, "binary") == 0) {
+                binary = true;
+            } else {
+                fprintf(stderr, "Invalid -protocol= argument (expected 'text' or 'binary'): '%s'.\n", v);
+                return 2;
+            }
+
+        } else if ((v = strfollow(arg, "-ack="))) {
+            const char *n;
+            if (strcmp(v, "every") == 0) {
+                ack_policy = ACK_EVERY;
+            } else if (strcmp(v, "none") == 0) {
+                ack_policy = ACK_NONE;
+            } else if (strcmp(v, "after-render") == 0) {
+                ack_policy = ACK_AFTER_RENDER;
+            } else if ((n = strfollow(v, "batch="))) {
+                int32_t r = parse_uint(n, strlen(n), INT32_MAX);
+                if (r <= 0) {
+                    fprintf(stderr, "Invalid -ack=batch= argument: %s.\n", r ? parse_uint_strerror(r) : "must be positive");
+                    return 2;
+                }
+                ack_policy = ACK_BATCH;
+                ack_batch = r;
+            } else {
+                fprintf(stderr, "Invalid -ack= argument (expected 'every', 'none', 'batch=N' or 'after-render'): '%s'.\n", v);
+                return 2;
+            }
+
+        } else if (strcmp(arg, "-ack-timing") == 0) {
+            ack_timing = true;
+
+        } else if ((v = strfollow(arg, "-stats-fd="))) {
+            int32_t r = parse_uint(v, strlen(v), INT32_MAX);
+            if (r < 0) {
+                fprintf(stderr, "Invalid -stats-fd= argument: %s.\n", parse_uint_strerror(r));
+                return 2;
+            }
+            stats_fd = r;
+
+        } else if ((v = strfollow(arg, "-stats-interval="))) {
+            int32_t r = parse_uint(v, strlen(v), INT32_MAX);
+            if (r <= 0) {
+                fprintf(stderr, "Invalid -stats-interval= argument: %s.\n", r ? parse_uint_strerror(r) : "must be positive");
+                return 2;
+            }
+            stats_interval_ms = r;
+
+        } else if ((v = strfollow(arg, "-trace="))) {
+            trace_path = v;
+
+        } else if ((v = strfollow(arg, "-save-snapshot="))) {
+            save_snapshot_path = v;
+
+        } else if ((v = strfollow(arg, "-load-snapshot="))) {
+            load_snapshot_path = v;
+
+        } else if (strcmp(arg, "-keyed") == 0) {
+            keyed = true;
+
+        } else if (strcmp(arg, "-persistent") == 0) {
+            persistent = true;
+
+        } else if ((v = strfollow(arg, "-file="))) {
+            file_path = v;
+
+        } else if ((v = strfollow(arg, "-file-format="))) {
+            if (strcmp(v, "tsv") == 0) {
+                file_sep = '\n';
+            } else if (strcmp(v, "nul") == 0) {
+                file_sep = '\0';
+            } else {
+                fprintf(stderr, "Invalid -file-format= argument (expected 'tsv' or 'nul'): '%s'.\n", v);
+                return 2;
+            }
+
+        } else if (strcmp(arg, "-virtual") == 0) {
+            virtual = true;
+
+        } else if ((v = strfollow(arg, "-virtual-cache="))) {
+            int32_t r = parse_uint(v, strlen(v), INT32_MAX);
+            if (r <= 0) {
+                fprintf(stderr, "Invalid -virtual-cache= argument: %s.\n", r ? parse_uint_strerror(r) : "must be positive");
+                return 2;
+            }
+            virtual_cache = r;
+
+        } else if ((v = strfollow(arg, "-sort="))) {
+            sort_arg = v;
+
+        } else if ((v = strfollow(arg, "-index="))) {
+            if (strcmp(v, "none") == 0) {
+                indexed = false;
+            } else if (strcmp(v, "trigram") == 0) {
+                indexed = true;
+            } else {
+                fprintf(stderr, "Invalid -index= argument (expected 'none' or 'trigram'): '%s'.\n", v);
+                return 2;
+            }
+
+        } else if ((v = strfollow(arg, "-max-fps="))) {
+            int32_t r = parse_uint(v, strlen(v), 1000000);
+            if (r < 0) {
+                fprintf(stderr, "Invalid -max-fps= argument: %s.\n", parse_uint_strerror(r));
+                return 2;
+            }
+            max_fps = r;
+
+        } else if ((v = strfollow(arg, "-frame-budget="))) {
+            int32_t r = parse_uint(v, strlen(v), 1000000);
+            if (r < 0) {
+                fprintf(stderr, "Invalid -frame-budget= argument: %s.\n", parse_uint_strerror(r));
+                return 2;
+            }
+            frame_budget_ms = r;
+
+        } else if ((v = strfollow(arg, "-filter-threads="))) {
+            int32_t r = parse_uint(v, strlen(v), 1024);
+            if (r <= 0) {
+                fprintf(stderr, "Invalid -filter-threads= argument: %s.\n", r ? parse_uint_strerror(r) : "must be positive");
+                return 2;
+            }
+            filter_nthreads = r;
+
         } else {
             fprintf(stderr, "Unknown option: '%s'.\n", arg);
             return 2;
         }
     }
 
+    if (virtual && (keyed || indexed || sort_arg)) {
+        fprintf(stderr, "-virtual cannot be combined with -keyed, -index=trigram or -sort=.\n");
+        return 2;
+    }
+
+    if (file_path && (virtual || keyed || indexed || sort_arg || ninfds)) {
+        fprintf(stderr, "-file= cannot be combined with -infd=, -virtual, -keyed, -index=trigram or -sort=.\n");
+        return 2;
+    }
+
+    if ((save_snapshot_path || load_snapshot_path) && (virtual || file_path)) {
+        fprintf(stderr, "-save-snapshot= and -load-snapshot= cannot be combined with -virtual or -file=.\n");
+        return 2;
+    }
+
+    // The columns come from the snapshot unless they are given.
+    Snapshot snapshot = {0};
+    if (load_snapshot_path) {
+        char err[256];
+        if (snapshot_open(&snapshot, load_snapshot_path, err, sizeof(err)) < 0) {
+            fprintf(stderr, "Cannot use -load-snapshot='%s': %s.\n", load_snapshot_path, err);
+            return 1;
+        }
+        if (!column_args.size) {
+            for (uint32_t i = 0; i < snapshot.header.ncols; ++i) {
+                string_vec_push(&column_args, snapshot.columns[i]);
+            }
+        } else if (column_args.size != snapshot.header.ncols) {
+            fprintf(stderr, "Cannot use -load-snapshot='%s': it has %u columns, not %zu.\n",
+                    load_snapshot_path, (unsigned) snapshot.header.ncols, column_args.size);
+            return 1;
+        }
+        if (!(snapshot.header.flags & SNAPSHOT_KEYED) != !keyed) {
+            fprintf(stderr, "Cannot use -load-snapshot='%s': it was saved %s -keyed.\n",
+                    load_snapshot_path, keyed ? "without" : "with");
+            return 1;
+        }
+    }
+
     if (!column_args.size) {
         fprintf(stderr, "No -column= arguments found.\n");
         return 2;
     }
 
-    if (infd < 0) {
+    if (!ninfds && !file_path) {
         fprintf(stderr, "No -infd= argument found.\n");
         return 2;
     }
 
-    if (outfd < 0) {
+    if (!noutfds) {
         fprintf(stderr, "No -outfd= argument found.\n");
         return 2;
     }
 
+    if (ninfds > 1 || noutfds > 1) {
+        if (ninfds != noutfds) {
+            fprintf(stderr, "There must be as many -outfd= arguments as -infd= arguments.\n");
+            return 2;
+        }
+        if (keyed || virtual || save_snapshot_path || load_snapshot_path) {
+            fprintf(stderr, "Several -infd= arguments cannot be combined with -keyed, -virtual, -save-snapshot= or -load-snapshot=.\n");
+            return 2;
+        }
+    }
+
     size_t nccs = command_args.size;
     CustomCommand *ccs = malloc_or_die(sizeof(CustomCommand), nccs);
     for (size_t i = 0; i < nccs; ++i) {
@@ -853,9 +3615,11 @@ int main(int argc, char **argv)
 
     size_t ncols = column_args.size;
     ListColumn *cols = malloc_or_die(sizeof(ListColumn), ncols);
-    TruncatedText *headers = malloc_or_die(sizeof(TruncatedText), ncols);
+    ListCell *headers = malloc_or_die(sizeof(ListCell), ncols);
+    TruncatedText *header_texts = malloc_or_die(sizeof(TruncatedText), ncols);
     uint32_t vw_denom = 0;
     uint32_t fw_sum = 0;
+    bool auto_widths = false;
 
     for (size_t i = 0; i < ncols; ++i) {
         const char *arg = column_args.data[i];
@@ -865,6 +3629,42 @@ int main(int argc, char **argv)
             return 2;
         }
 
+        // auto[:MIN-MAX]:TITLE
+        const char *title = colon + 1;
+        if (colon - arg == 4 && memcmp(arg, "auto", 4) == 0) {
+            uint32_t auto_min = 0;
+            uint32_t auto_max = AUTO_WIDTH_LIMIT;
+            const char *range_end = strchr(title, ':');
+            if (range_end && title[0] >= '0' && title[0] <= '9') {
+                const char *dash = memchr(title, '-', range_end - title);
+                int64_t rmin = dash ? parse_uint(title, dash - title, AUTO_WIDTH_LIMIT) : -1;
+                int64_t rmax = dash ? parse_uint(dash + 1, range_end - dash - 1, AUTO_WIDTH_LIMIT) : -1;
+                if (rmin < 0 || rmax <= 0 || rmin > rmax) {
+                    fprintf(stderr, "Invalid width range in -column='%s' (expected MIN-MAX, with 0 <= MIN <= MAX, 0 < MAX <= %d).\n",
+                            arg, (int) AUTO_WIDTH_LIMIT);
+                    return 2;
+                }
+                auto_min = rmin;
+                auto_max = rmax;
+                title = range_end + 1;
+            }
+            header_texts[i] = truncated_text_from_span(title, strlen(title));
+            headers[i] = (ListCell) {
+                .raw = title,
+                .nraw = strlen(title),
+                .text = &header_texts[i],
+            };
+            cols[i] = (ListColumn) {
+                .is_auto = true,
+                .auto_min = auto_min,
+                .auto_max = auto_max,
+                // Filled by 'list_reset_auto_widths()'.
+                .nwidths = malloc_or_die(auto_max + 1, sizeof(uint64_t)),
+            };
+            auto_widths = true;
+            continue;
+        }
+
         int32_t w = 1;
         if (colon != arg) {
             const char *number_start = arg;
@@ -881,7 +3681,12 @@ int main(int argc, char **argv)
             w = negate ? -r : r;
         }
 
-        headers[i] = truncated_text_from_cstr(colon + 1);
+        header_texts[i] = truncated_text_from_span(title, strlen(title));
+        headers[i] = (ListCell) {
+            .raw = title,
+            .nraw = strlen(title),
+            .text = &header_texts[i],
+        };
         cols[i] = (ListColumn) {.w = w};
 
         if (w >= 0) {
@@ -904,16 +3709,112 @@ int main(int argc, char **argv)
         fw_sum = 1;
     }
 
+    if (auto_widths && file_path) {
+        fprintf(stderr, "-file= cannot be combined with -column=auto.\n");
+        return 2;
+    }
+
+    size_t sort_col = 0;
+    bool sort_numeric = false;
+    bool sort_desc = false;
+    if (sort_arg) {
+        const char *colon = strchr(sort_arg, ':');
+        size_t ncol = colon ? (size_t) (colon - sort_arg) : strlen(sort_arg);
+        int32_t r = parse_uint(sort_arg, ncol, ncols);
+        if (r <= 0) {
+            fprintf(
+                stderr, "Invalid column number in -sort='%s': %s.\n",
+                sort_arg, r ? parse_uint_strerror(r) : "columns are numbered from 1");
+            return 2;
+        }
+        sort_col = r - 1;
+        while (colon) {
+            const char *word = colon + 1;
+            colon = strchr(word, ':');
+            size_t nword = colon ? (size_t) (colon - word) : strlen(word);
+            if (nword == 3 && memcmp(word, "num", 3) == 0) {
+                sort_numeric = true;
+            } else if (nword == 3 && memcmp(word, "str", 3) == 0) {
+                sort_numeric = false;
+            } else if (nword == 4 && memcmp(word, "desc", 4) == 0) {
+                sort_desc = true;
+            } else {
+                fprintf(stderr, "Invalid -sort= argument (expected 'num', 'str' or 'desc' after ':'): '%s'.\n", sort_arg);
+                return 2;
+            }
+        }
+    }
+
     if (reset_std_fds() < 0) {
         return 1;
     }
 
-    if (check_fd(infd, "input fd") < 0) {
-        return 1;
+    // With '-file=', the only source has no input fd.
+    size_t nsources = noutfds;
+    Source *sources = malloc_or_die(sizeof(Source), nsources);
+    for (size_t i = 0; i < nsources; ++i) {
+        int infd = ninfds ? infds[i] : -1;
+        if (infd >= 0 && check_fd(infd, "input fd") < 0) {
+            return 1;
+        }
+
+        // Packs are applied step by step as they arrive (see 'handle_infile_step()').
+        if (infd >= 0 && fcntl(infd, F_SETFL, fcntl(infd, F_GETFL) | O_NONBLOCK) < 0) {
+            fprintf(stderr, "Cannot make input fd non-blocking: %s\n", strerror(errno));
+            return 1;
+        }
+
+        if (check_fd(outfds[i], "output fd") < 0) {
+            return 1;
+        }
+        sources[i] = (Source) {
+            .infile = {
+                .fd = infd,
+            },
+            .outfd = outfds[i],
+        };
     }
 
-    if (check_fd(outfd, "output fd") < 0) {
-        return 1;
+    Stats stats = {0};
+    if (stats_fd >= 0) {
+        if (check_fd(stats_fd, "stats fd") < 0) {
+            return 1;
+        }
+        // A slow reader must not hold up the UI (see 'write_stats()').
+        if (fcntl(stats_fd, F_SETFL, fcntl(stats_fd, F_GETFL) | O_NONBLOCK) < 0) {
+            fprintf(stderr, "Cannot make stats fd non-blocking: %s\n", strerror(errno));
+            return 1;
+        }
+        global_stats = &stats;
+    }
+
+    Tracer tracer = {0};
+    if (trace_path) {
+        tracer_init(&tracer);
+        // Fail now rather than after the session if the file cannot be written.
+        if (tracer_write(&tracer, trace_path) < 0) {
+            fprintf(stderr, "Cannot write -trace='%s': %s.\n", trace_path, strerror(errno));
+            return 1;
+        }
+        struct sigaction sa = {.sa_handler = handle_sigusr1};
+        sigemptyset(&sa.sa_mask);
+        sigaction(SIGUSR1, &sa, NULL);
+        global_tracer = &tracer;
+    }
+
+    if (save_snapshot_path) {
+        struct sigaction sa = {.sa_handler = handle_sigusr2};
+        sigemptyset(&sa.sa_mask);
+        sigaction(SIGUSR2, &sa, NULL);
+    }
+
+    LineFile file = {0};
+    if (file_path) {
+        char err[256];
+        if (line_file_open(&file, file_path, file_sep, err, sizeof(err)) < 0) {
+            fprintf(stderr, "Cannot use -file='%s': %s.\n", file_path, err);
+            return 1;
+        }
     }
 
     initscr();
@@ -923,6 +3824,8 @@ int main(int argc, char **argv)
     nonl();
     intrflush(stdscr, FALSE);
     keypad(stdscr, TRUE);
+    // Let ncurses use insert/delete line when 'redraw()' scrolls.
+    idlok(stdscr, TRUE);
     set_escdelay(50);
     halfdelay(1);
 
@@ -932,34 +3835,103 @@ int main(int argc, char **argv)
         .ncols = ncols,
         .cols = cols,
         .headers = headers,
+        .scratch_offsets = malloc_or_die(sizeof(size_t), ncols),
         .vw_denom = vw_denom,
         .fw_sum = fw_sum,
-        .infile = {
-            .fd = infd,
-        },
-        .outfd = outfd,
+        .auto_widths = auto_widths,
+        .sources = sources,
+        .nsources = nsources,
+        .src = sources,
+        .binary = binary,
         .nccs = nccs,
         .ccs = ccs,
+        .pacer = {
+            .min_interval = max_fps ? 1000000000 / max_fps : 0,
+            .budget = ((int64_t) frame_budget_ms) * 1000000,
+        },
+        .filter_nthreads = filter_nthreads,
+        .indexed = indexed,
+        .keyed = keyed,
+        .persistent = persistent,
+        .virtual = virtual,
+        .ack_policy = ack_policy,
+        .ack_batch = ack_batch,
+        .ack_timing = ack_timing,
+        .max_windows = (virtual_cache + VIRTUAL_WINDOW - 1) / VIRTUAL_WINDOW,
+        .from_file = file_path != NULL,
+        .file_scanning = file_path != NULL,
+        .file = file,
+        .snapshot = snapshot,
+        .snapshot_loading = load_snapshot_path != NULL,
+        .sorting = sort_arg != NULL,
+        .sort_col = sort_col,
+        .sort_numeric = sort_numeric,
+        .sort_desc = sort_desc,
     };
 
+    list_reset_auto_widths(&list);
+
     intern_style(style_header, 1, &list.style_header);
     intern_style(style_hi,     2, &list.style_highlight);
     intern_style(style_entry,  3, &list.style_entry);
 
-    struct pollfd pfds[2] = {
-        {.fd = infd, .events = POLLIN},
-        {.fd = 0,    .events = POLLIN},
-    };
+    // The keyboard, then the input fds of the sources (see 'poll_sources()').
+    size_t npfds = 1 + nsources;
+    struct pollfd *pfds = malloc_or_die(sizeof(struct pollfd), npfds);
+    pfds[0] = (struct pollfd) {.fd = 0, .events = POLLIN};
+
+    // The first frame.
+    pacer_event(&list.pacer, pacer_now());
 
     bool requery_size = true;
+    int caught_signal = 0;
+    int64_t started = pacer_now();
+    int64_t stats_next = started + ((int64_t) stats_interval_ms) * 1000000;
 again:
-    redraw(&list, requery_size);
-    requery_size = false;
+    (void) 0;
+    int64_t now = pacer_now();
+    if (global_stats && now >= stats_next) {
+        if (write_stats(&list, stats_fd, now - started) < 0) {
+            // Nobody is listening; stop counting.
+            global_stats = NULL;
+        }
+        stats_next = now + ((int64_t) stats_interval_ms) * 1000000;
+    }
+    if (trace_requested) {
+        trace_requested = 0;
+        if (tracer_write(&tracer, trace_path) < 0) {
+            errmsgf("Cannot write -trace='%s': %s.\n", trace_path, strerror(errno));
+        }
+    }
+    if (snapshot_requested && !list_in_pack(&list) && !list.snapshot_loading) {
+        snapshot_requested = 0;
+        if (list_save_snapshot(&list, save_snapshot_path, column_args.data) < 0) {
+            errmsgf("Cannot write -save-snapshot='%s': %s.\n", save_snapshot_path, strerror(errno));
+        }
+    }
+    if (pacer_must_render(&list.pacer, now)) {
+        goto render;
+    }
 
-    if (bio_has_something(&list.infile)) {
-        goto handle_infile_input;
+    // While there is more input to apply, or the filter scan or the file scan goes on, only check
+    // for new events between their steps.
+    bool infile_more = poll_sources(&list, pfds + 1);
+    bool busy = infile_more || list.filter_scanning || list.file_scanning || list.snapshot_loading;
+    int timeout = busy ? 0 : pacer_timeout(&list.pacer, now);
+    if (global_stats) {
+        // Wake up for the next report, rounding up.
+        int64_t left = (stats_next - now + 999999) / 1000000;
+        if (timeout < 0 || left < timeout) {
+            timeout = left;
+        }
     }
-    if (poll(pfds, 2, -1) < 0) {
+    int64_t poll_started = trace_begin();
+    int npolled = poll(pfds, npfds, timeout);
+    trace_end("poll", poll_started);
+    if (npolled < 0) {
+        if (trace_requested || snapshot_requested) {
+            goto again;
+        }
         if (errno == EINTR) {
             goto handle_ncurses_input;
         } else {
@@ -968,26 +3940,126 @@ again:
             goto done;
         }
     }
+    if (npolled == 0) {
+        if (infile_more) {
+            goto handle_infile_input;
+        }
+        if (list.filter_scanning) {
+            goto filter_step;
+        }
+        if (list.file_scanning) {
+            goto file_step;
+        }
+        if (list.snapshot_loading) {
+            goto snapshot_step;
+        }
+        // The wakeup may only be for the next report of the statistics, with no frame pending or
+        // the frame not allowed yet.
+        if (!list.pacer.pending || pacer_timeout(&list.pacer, pacer_now()) > 0) {
+            goto again;
+        }
+        // Nothing else is coming right now, and we are allowed to render.
+        goto render;
+    }
+    // Keystrokes first, so that a steady stream of input does not keep the keyboard waiting.
     if (pfds[0].revents) {
-        goto handle_infile_input;
+        goto handle_ncurses_input;
     }
-    if (pfds[1].revents) {
+    goto handle_infile_input;
+
+render:
+    (void) 0;
+    int64_t render_started = pacer_now();
+    redraw(&list, requery_size);
+    requery_size = false;
+    int64_t rendered = pacer_now();
+    pacer_frame(&list.pacer, rendered);
+    if (global_stats) {
+        histogram_add(&global_stats->redraw, rendered - render_started);
+        if (global_stats->key_pending_since) {
+            histogram_add(&global_stats->key_to_frame, rendered - global_stats->key_pending_since);
+            global_stats->key_pending_since = 0;
+        }
+    }
+    if (global_tracer) {
+        trace_record("redraw", render_started, rendered, TRACK_MAIN);
+        if (global_tracer->key_pending_since) {
+            histogram_add(&global_tracer->key_to_refresh, rendered - global_tracer->key_pending_since);
+            global_tracer->key_pending_since = 0;
+        }
+    }
+    caught_signal = 0;
+    if (flush_acks(&list, rendered - render_started, &caught_signal) < 0) {
+        ret = 1;
+        goto done;
+    }
+    if (list_virtual_fetch(&list, &caught_signal) < 0) {
+        ret = 1;
+        goto done;
+    }
+    if (caught_signal) {
         goto handle_ncurses_input;
     }
     goto again;
 
-handle_infile_input:
-    (void) 0;
-    bool close_infile = false;
-    int caught_signal = 0;
-    if (handle_infile_line(&list, &close_infile, &caught_signal) < 0) {
+filter_step:
+    pacer_event(&list.pacer, pacer_now());
+    int64_t filter_started = trace_begin();
+    list_filter_step(&list);
+    trace_end("filter step", filter_started);
+    goto again;
+
+file_step:
+    pacer_event(&list.pacer, pacer_now());
+    int64_t file_started = trace_begin();
+    list_file_step(&list);
+    trace_end("file step", file_started);
+    goto again;
+
+snapshot_step:
+    pacer_event(&list.pacer, pacer_now());
+    int64_t snapshot_started = trace_begin();
+    if (list_snapshot_step(&list) < 0) {
         ret = 1;
         goto done;
     }
-    if (close_infile) {
-        close(list.infile.fd);
-        pfds[0].fd = -1;
-        bio_reset(&list.infile);
+    trace_end("snapshot step", snapshot_started);
+    goto again;
+
+handle_infile_input:
+    // One step for every source that has input, so that a flood from one of them does not hold up
+    // the others.
+    pacer_event(&list.pacer, pacer_now());
+    caught_signal = 0;
+    for (size_t i = 0; i < nsources; ++i) {
+        Source *src = &sources[i];
+        if (pfds[1 + i].fd < 0 || !(pfds[1 + i].revents || src->more)) {
+            continue;
+        }
+        pfds[1 + i].revents = 0;
+        bool close_infile = false;
+        int64_t infile_started = trace_begin();
+        int r = handle_infile_step(&list, src, &close_infile, &caught_signal);
+        trace_end("infile step", infile_started);
+        if (r < 0) {
+            ret = 1;
+            goto done;
+        }
+        if (close_infile) {
+            close(src->infile.fd);
+            bio_reset(&src->infile);
+            src->more = false;
+        }
+    }
+    if (list.exit_pending && !list_in_pack(&list) && finish_exit_pending(&list, &ret)) {
+        goto done;
+    }
+    if (list.quit_pending && !list_in_pack(&list)) {
+        // The packs held back for a frame are acknowledged all the same.
+        if (flush_acks(&list, 0, &caught_signal) < 0) {
+            ret = 1;
+        }
+        goto done;
     }
     if (caught_signal) {
         goto handle_ncurses_input;
@@ -995,6 +4067,13 @@ handle_infile_input:
     goto again;
 
 handle_ncurses_input:
+    pacer_event(&list.pacer, pacer_now());
+    if (global_stats && !global_stats->key_pending_since) {
+        global_stats->key_pending_since = pacer_now();
+    }
+    if (global_tracer && !global_tracer->key_pending_since) {
+        global_tracer->key_pending_since = pacer_now();
+    }
     if (handle_input(&list, &requery_size, &ret) < 0) {
         goto done;
     }
@@ -1002,6 +4081,32 @@ handle_ncurses_input:
 
 done:
     endwin();
+    if (global_stats) {
+        write_stats(&list, stats_fd, pacer_now() - started);
+    }
+    if (list.from_file) {
+        line_file_close(&list.file);
+    }
+    // Not after an error, which may have left the list in between states.
+    if (save_snapshot_path && ret == 0) {
+        while (list.snapshot_loading && ret == 0) {
+            if (list_snapshot_step(&list) < 0) {
+                ret = 1;
+            }
+        }
+        if (ret == 0 && list_save_snapshot(&list, save_snapshot_path, column_args.data) < 0) {
+            errmsgf("Cannot write -save-snapshot='%s': %s.\n", save_snapshot_path, strerror(errno));
+            ret = 1;
+        }
+    }
+    if (global_tracer && tracer_write(&tracer, trace_path) < 0) {
+        errmsgf("Cannot write -trace='%s': %s.\n", trace_path, strerror(errno));
+    }
+    // The cells of the loaded entries and the column arguments point into the mapping, so this
+    // comes after the last use of the list.
+    if (load_snapshot_path) {
+        snapshot_close(&list.snapshot);
+    }
     if (global_errmsg[0]) {
         fputs(global_errmsg, stderr);
     }
@@ -1,4 +1,5 @@
 #include "common.h"
+#include "stats.h"
 
 #include <stdio.h>
 #include <stdint.h>
@@ -16,6 +17,9 @@ void *realloc_or_die(void *p, size_t n, size_t m)
     if (m && n > SIZE_MAX / m) {
         die_out_of_memory();
     }
+    if (global_stats) {
+        ++global_stats->nallocs;
+    }
     void *r = realloc(p, n * m);
     if (!r && n && m) {
         die_out_of_memory();
@@ -28,6 +32,18 @@ void *malloc_or_die(size_t n, size_t m)
     return realloc_or_die(NULL, n, m);
 }
 
+void *calloc_or_die(size_t n, size_t m)
+{
+    if (global_stats) {
+        ++global_stats->nallocs;
+    }
+    void *r = calloc(n, m);
+    if (!r && n && m) {
+        die_out_of_memory();
+    }
+    return r;
+}
+
 void *memdup_or_die(const void *p, size_t n)
 {
     void *q = malloc_or_die(n, 1);
@@ -6,6 +6,9 @@ void die_out_of_memory(void);
 
 void *malloc_or_die(size_t n, size_t m);
 
+// Like 'malloc_or_die()', but the memory is zeroed.
+void *calloc_or_die(size_t n, size_t m);
+
 void *realloc_or_die(void *p, size_t n, size_t m);
 
 void *x2realloc_or_die(void *p, size_t *n, size_t m);
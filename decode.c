@@ -1,22 +1,58 @@
 #include "decode.h"
 #include "common.h"
+#include "utf8.h"
 #include <stdlib.h>
+#include <limits.h>
 
-wchar_t *decode_copy(const char *s)
+ssize_t decode_append(const char *s, size_t ns, wchar_t **pbuf, size_t *pnbuf, size_t off)
 {
-    size_t nbuf = 1;
-    wchar_t *buf = malloc_or_die(nbuf, sizeof(wchar_t));
+    if (utf8_enabled) {
+        return utf8_decode_append(s, ns, pbuf, pnbuf, off);
+    }
+
+    const char *x = s;
+    mbstate_t state = {0};
+    size_t n = 0;
     for (;;) {
-        const char *x = s;
-        mbstate_t state = {0};
-        size_t r = mbsrtowcs(buf, &x, nbuf, &state);
+        // Leave room for the terminating null character.
+        while (*pnbuf - off - n < 2) {
+            *pbuf = x2realloc_or_die(*pbuf, pnbuf, sizeof(wchar_t));
+        }
+        const char *prev = x;
+        // Unlike restarting from scratch, this continues from where the last call stopped.
+        size_t r = mbsnrtowcs(*pbuf + off + n, &x, ns, *pnbuf - off - n - 1, &state);
         if (r == (size_t) -1) {
-            free(buf);
-            return NULL;
+            return -1;
         }
+        n += r;
         if (!x) {
-            return buf;
+            // Stopped at a null byte, which has been stored as well.
+            break;
         }
-        buf = x2realloc_or_die(buf, &nbuf, sizeof(wchar_t));
+        ns -= x - prev;
+        if (!ns) {
+            if (!mbsinit(&state)) {
+                // Incomplete multibyte sequence at the end.
+                return -1;
+            }
+            (*pbuf)[off + n] = L'\0';
+            break;
+        }
+        *pbuf = x2realloc_or_die(*pbuf, pnbuf, sizeof(wchar_t));
+    }
+    if (n > (size_t) SSIZE_MAX) {
+        die_out_of_memory();
+    }
+    return n;
+}
+
+wchar_t *decode_copy(const char *s, size_t ns)
+{
+    wchar_t *buf = NULL;
+    size_t nbuf = 0;
+    if (decode_append(s, ns, &buf, &nbuf, 0) < 0) {
+        free(buf);
+        return NULL;
     }
+    return buf;
 }
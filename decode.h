@@ -1,6 +1,14 @@
 #pragma once
 
 #include <wchar.h>
+#include <stddef.h>
+#include <sys/types.h>
 
-// Returns NULL on encoding error.
-wchar_t *decode_copy(const char *s);
+// Decodes at most 'ns' bytes of 's' (stopping at a null byte, if any) into '*pbuf', starting at
+// index 'off' and growing the buffer as needed; a terminating null character is stored too. Returns
+// the number of wide characters decoded (not counting the terminating one), or -1 on encoding error.
+ssize_t decode_append(const char *s, size_t ns, wchar_t **pbuf, size_t *pnbuf, size_t off);
+
+// Decodes at most 'ns' bytes of 's' (stopping at a null byte, if any). Returns NULL on encoding
+// error.
+wchar_t *decode_copy(const char *s, size_t ns);
@@ -0,0 +1,81 @@
+// Generates a two-level table of character widths, as reported by wcwidth() in a UTF-8 locale, for
+// all the Unicode code points. The output is a C header; see utf8.c.
+
+#include <wchar.h>
+#include <locale.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+enum {
+    NCODEPOINTS = 0x110000,
+    BLOCK = 256,
+    NBLOCKS = NCODEPOINTS / BLOCK,
+};
+
+// 0, 1 and 2 stand for themselves; 3 stands for "not printable" (-1).
+static uint8_t encode_width(int w)
+{
+    return w < 0 ? 3 : w;
+}
+
+int main(void)
+{
+    static const char *locales[] = {"C.UTF-8", "C.utf8", "en_US.UTF-8", "en_US.utf8"};
+    const char *loc = NULL;
+    for (size_t i = 0; i < sizeof(locales) / sizeof(locales[0]); ++i) {
+        if (setlocale(LC_CTYPE, locales[i])) {
+            loc = locales[i];
+            break;
+        }
+    }
+    if (!loc) {
+        fputs("gen_width_table: no UTF-8 locale available.\n", stderr);
+        return 1;
+    }
+
+    static uint8_t widths[NCODEPOINTS];
+    for (uint32_t c = 0; c < NCODEPOINTS; ++c) {
+        if (c >= 0xD800 && c <= 0xDFFF) {
+            widths[c] = encode_width(-1);
+        } else {
+            widths[c] = encode_width(wcwidth((wchar_t) c));
+        }
+    }
+
+    static uint16_t stage1[NBLOCKS];
+    static uint32_t unique[NBLOCKS];
+    size_t nunique = 0;
+    for (size_t b = 0; b < NBLOCKS; ++b) {
+        size_t j = 0;
+        for (; j < nunique; ++j) {
+            if (memcmp(&widths[unique[j] * BLOCK], &widths[b * BLOCK], BLOCK) == 0)
+                break;
+        }
+        if (j == nunique)
+            unique[nunique++] = b;
+        stage1[b] = j;
+    }
+
+    printf("// Generated by gen_width_table from wcwidth() in the '%s' locale; do not edit.\n\n", loc);
+    printf("enum { WIDTH_TABLE_BLOCK = %d };\n\n", BLOCK);
+    printf("static const uint16_t width_stage1[%d] = {", NBLOCKS);
+    for (size_t b = 0; b < NBLOCKS; ++b)
+        printf("%s%u,", b % 16 ? "" : "\n    ", (unsigned) stage1[b]);
+    printf("\n};\n\n");
+
+    // Four 2-bit widths per byte.
+    printf("static const uint8_t width_stage2[%zu][%d] = {\n", nunique, BLOCK / 4);
+    for (size_t j = 0; j < nunique; ++j) {
+        const uint8_t *w = &widths[unique[j] * BLOCK];
+        printf("    {");
+        for (size_t k = 0; k < BLOCK; k += 4) {
+            unsigned packed = w[k] | (w[k + 1] << 2) | (w[k + 2] << 4) | (w[k + 3] << 6);
+            printf("%s%u,", k % 64 ? "" : "\n        ", packed);
+        }
+        printf("\n    },\n");
+    }
+    printf("};\n");
+    return 0;
+}
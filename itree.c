@@ -0,0 +1,339 @@
+#include "itree.h"
+
+static inline size_t node_size(const ITreeNode *n)
+{
+    return n ? n->size : 0;
+}
+
+static inline size_t node_nvisible(const ITreeNode *n)
+{
+    return n ? n->nvisible : 0;
+}
+
+static inline void mark(ITreeNode *n, bool visible)
+{
+    if (!n)
+        return;
+    n->visible = visible;
+    n->nvisible = visible ? n->size : 0;
+    n->pending = true;
+}
+
+// Passes the mark of 'itree_set_all_visible()' on to the children of 'n'. The tree is changed, but
+// not in a way that can be observed, so this is also done on the nodes of a const tree.
+static inline void push(ITreeNode *n)
+{
+    if (!n->pending)
+        return;
+    mark(n->left, n->visible);
+    mark(n->right, n->visible);
+    n->pending = false;
+}
+
+// Pushes the marks down from the root to 'n', so that 'n' and its children are up to date.
+static void push_path(ITreeNode *n)
+{
+    if (n->parent)
+        push_path(n->parent);
+    push(n);
+}
+
+static inline void pull(ITreeNode *n)
+{
+    n->size = 1 + node_size(n->left) + node_size(n->right);
+    n->nvisible = n->visible + node_nvisible(n->left) + node_nvisible(n->right);
+    if (n->left)
+        n->left->parent = n;
+    if (n->right)
+        n->right->parent = n;
+}
+
+static uint32_t next_prio(ITree *t)
+{
+    // xorshift32.
+    uint32_t x = t->seed ? t->seed : 2463534242u;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    t->seed = x;
+    return x;
+}
+
+static ITreeNode *merge(ITreeNode *a, ITreeNode *b)
+{
+    if (!a)
+        return b;
+    if (!b)
+        return a;
+    if (a->prio > b->prio) {
+        push(a);
+        a->right = merge(a->right, b);
+        pull(a);
+        return a;
+    } else {
+        push(b);
+        b->left = merge(a, b->left);
+        pull(b);
+        return b;
+    }
+}
+
+// Splits 'n' so that the first 'k' nodes go to '*l' and the rest go to '*r'.
+static void split(ITreeNode *n, size_t k, ITreeNode **l, ITreeNode **r)
+{
+    if (!n) {
+        *l = NULL;
+        *r = NULL;
+        return;
+    }
+    push(n);
+    size_t nleft = node_size(n->left);
+    if (k <= nleft) {
+        split(n->left, k, l, &n->left);
+        pull(n);
+        *r = n;
+    } else {
+        split(n->right, k - nleft - 1, &n->right, r);
+        pull(n);
+        *l = n;
+    }
+}
+
+static inline void set_root(ITree *t, ITreeNode *root)
+{
+    if (root)
+        root->parent = NULL;
+    t->root = root;
+}
+
+ITreeNode *itree_at(const ITree *t, size_t idx)
+{
+    ITreeNode *n = t->root;
+    while (n) {
+        size_t nleft = node_size(n->left);
+        if (idx < nleft) {
+            n = n->left;
+        } else if (idx == nleft) {
+            return n;
+        } else {
+            idx -= nleft + 1;
+            n = n->right;
+        }
+    }
+    return NULL;
+}
+
+ITreeNode *itree_at_visible(const ITree *t, size_t k)
+{
+    ITreeNode *n = t->root;
+    while (n) {
+        push(n);
+        size_t nleft = node_nvisible(n->left);
+        if (k < nleft) {
+            n = n->left;
+        } else if (k == nleft && n->visible) {
+            return n;
+        } else {
+            k -= nleft + n->visible;
+            n = n->right;
+        }
+    }
+    return NULL;
+}
+
+size_t itree_nvisible_before(const ITree *t, size_t idx)
+{
+    size_t r = 0;
+    ITreeNode *n = t->root;
+    while (n) {
+        push(n);
+        size_t nleft = node_size(n->left);
+        if (idx <= nleft) {
+            n = n->left;
+        } else {
+            r += node_nvisible(n->left) + n->visible;
+            idx -= nleft + 1;
+            n = n->right;
+        }
+    }
+    return r;
+}
+
+size_t itree_search(const ITree *t, bool (*before)(const ITreeNode *node, void *userdata), void *userdata)
+{
+    size_t r = 0;
+    ITreeNode *n = t->root;
+    while (n) {
+        if (before(n, userdata)) {
+            r += node_size(n->left) + 1;
+            n = n->right;
+        } else {
+            n = n->left;
+        }
+    }
+    return r;
+}
+
+size_t itree_rank(const ITreeNode *node)
+{
+    size_t r = node_size(node->left);
+    for (const ITreeNode *p = node->parent; p; node = p, p = p->parent) {
+        if (p->right == node)
+            r += node_size(p->left) + 1;
+    }
+    return r;
+}
+
+ITreeNode *itree_next(const ITreeNode *node)
+{
+    if (node->right) {
+        ITreeNode *n = node->right;
+        while (n->left)
+            n = n->left;
+        return n;
+    }
+    ITreeNode *p = node->parent;
+    while (p && p->right == node) {
+        node = p;
+        p = p->parent;
+    }
+    return p;
+}
+
+// Returns the first visible node in the subtree rooted at 'n', which must have some.
+static ITreeNode *first_visible(ITreeNode *n)
+{
+    for (;;) {
+        push(n);
+        if (node_nvisible(n->left)) {
+            n = n->left;
+        } else if (n->visible) {
+            return n;
+        } else {
+            n = n->right;
+        }
+    }
+}
+
+ITreeNode *itree_next_visible(const ITreeNode *node)
+{
+    push_path((ITreeNode *) node);
+    if (node_nvisible(node->right))
+        return first_visible(node->right);
+    for (ITreeNode *p = node->parent; p; node = p, p = p->parent) {
+        if (p->left == node) {
+            if (p->visible)
+                return p;
+            if (node_nvisible(p->right))
+                return first_visible(p->right);
+        }
+    }
+    return NULL;
+}
+
+bool itree_is_visible(const ITreeNode *node)
+{
+    push_path((ITreeNode *) node);
+    return node->visible;
+}
+
+void itree_set_visible(ITreeNode *node, bool visible)
+{
+    push_path(node);
+    if (node->visible == visible)
+        return;
+    node->visible = visible;
+    for (ITreeNode *n = node; n; n = n->parent) {
+        if (visible) {
+            ++n->nvisible;
+        } else {
+            --n->nvisible;
+        }
+    }
+}
+
+void itree_set_all_visible(ITree *t, bool visible)
+{
+    mark(t->root, visible);
+}
+
+void itree_insert(ITree *t, size_t idx, ITreeNode *node)
+{
+    *node = (ITreeNode) {
+        .size = 1,
+        .nvisible = 1,
+        .prio = next_prio(t),
+        .visible = true,
+    };
+    ITreeNode *l;
+    ITreeNode *r;
+    split(t->root, idx, &l, &r);
+    set_root(t, merge(merge(l, node), r));
+}
+
+ITreeNode *itree_remove(ITree *t, size_t idx)
+{
+    ITreeNode *l;
+    ITreeNode *m;
+    ITreeNode *r;
+    split(t->root, idx, &l, &m);
+    split(m, 1, &m, &r);
+    set_root(t, merge(l, r));
+    return m;
+}
+
+void itree_replace(ITree *t, ITreeNode *old, ITreeNode *node)
+{
+    *node = *old;
+    if (node->left)
+        node->left->parent = node;
+    if (node->right)
+        node->right->parent = node;
+
+    ITreeNode *p = node->parent;
+    if (!p) {
+        t->root = node;
+    } else if (p->left == old) {
+        p->left = node;
+    } else {
+        p->right = node;
+    }
+}
+
+void itree_cut(ITree *t, size_t from, size_t count, ITree *out)
+{
+    ITreeNode *l;
+    ITreeNode *m;
+    ITreeNode *r;
+    split(t->root, from, &l, &m);
+    split(m, count, &m, &r);
+    set_root(t, merge(l, r));
+    *out = (ITree) {.seed = t->seed};
+    set_root(out, m);
+}
+
+void itree_destroy(ITree *t, void (*fn)(ITreeNode *node, void *userdata), void *userdata)
+{
+    ITreeNode *n = t->root;
+    while (n) {
+        if (n->left) {
+            n = n->left;
+            continue;
+        }
+        if (n->right) {
+            n = n->right;
+            continue;
+        }
+        ITreeNode *p = n->parent;
+        if (p) {
+            if (p->left == n) {
+                p->left = NULL;
+            } else {
+                p->right = NULL;
+            }
+        }
+        fn(n, userdata);
+        n = p;
+    }
+    t->root = NULL;
+}
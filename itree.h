@@ -0,0 +1,97 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// An intrusive implicit treap: nodes are ordered by their position, not by a key. The node is meant
+// to be embedded into the user's structure; nodes never move in memory, so pointers to them stay
+// valid across insertions and deletions of other nodes.
+//
+// Each node is either visible or hidden (nodes are inserted visible), and the tree keeps track of
+// how many visible nodes each subtree has, so that the visible nodes can also be addressed by their
+// position among the visible ones.
+//
+// All the operations below take expected O(log n) time, except for 'itree_destroy()', which takes
+// O(n) time, and 'itree_set_all_visible()', which takes O(1) time: it only marks the root, and the
+// mark is pushed down to the children of a node whenever the node is visited.
+
+typedef struct ITreeNode {
+    struct ITreeNode *left;
+    struct ITreeNode *right;
+    struct ITreeNode *parent;
+
+    // Number of nodes in the subtree rooted at this node.
+    size_t size;
+
+    // Number of visible nodes in the subtree rooted at this node.
+    size_t nvisible;
+
+    uint32_t prio;
+    bool visible;
+
+    // Whether all the nodes below this one are to get the visibility of this one (and their
+    // 'nvisible' counts are stale).
+    bool pending;
+} ITreeNode;
+
+typedef struct {
+    ITreeNode *root;
+    uint32_t seed;
+} ITree;
+
+static inline size_t itree_size(const ITree *t)
+{
+    return t->root ? t->root->size : 0;
+}
+
+static inline size_t itree_nvisible(const ITree *t)
+{
+    return t->root ? t->root->nvisible : 0;
+}
+
+// Returns NULL if 'idx' is out of range.
+ITreeNode *itree_at(const ITree *t, size_t idx);
+
+// Returns the visible node that has 'k' visible nodes before it, or NULL if there is none.
+ITreeNode *itree_at_visible(const ITree *t, size_t k);
+
+// Returns the number of visible nodes at positions less than 'idx'.
+size_t itree_nvisible_before(const ITree *t, size_t idx);
+
+// Returns the number of leading nodes for which 'before(node, userdata)' is true; it must be true
+// for all the nodes up to some position, and false for the rest.
+size_t itree_search(const ITree *t, bool (*before)(const ITreeNode *node, void *userdata), void *userdata);
+
+// Returns the position of 'node' in its tree.
+size_t itree_rank(const ITreeNode *node);
+
+// Returns NULL if 'node' is the last one.
+ITreeNode *itree_next(const ITreeNode *node);
+
+// Returns the first visible node after 'node', or NULL if there is none.
+ITreeNode *itree_next_visible(const ITreeNode *node);
+
+bool itree_is_visible(const ITreeNode *node);
+
+void itree_set_visible(ITreeNode *node, bool visible);
+
+// Makes all the nodes visible or hidden.
+void itree_set_all_visible(ITree *t, bool visible);
+
+// Inserts 'node' so that it ends up at position 'idx'; 'idx' must not be greater than the size.
+void itree_insert(ITree *t, size_t idx, ITreeNode *node);
+
+// Removes the node at position 'idx' and returns it; 'idx' must be in range.
+ITreeNode *itree_remove(ITree *t, size_t idx);
+
+// Puts 'node' in place of 'old', which must be in the tree.
+void itree_replace(ITree *t, ITreeNode *old, ITreeNode *node);
+
+// Removes up to 'count' nodes starting at position 'from' and moves them into '*out' (which is
+// overwritten). Nodes past the end are ignored.
+void itree_cut(ITree *t, size_t from, size_t count, ITree *out);
+
+// Calls 'fn' on every node of the tree (in no particular order) and makes the tree empty. It is
+// safe for 'fn' to free the node.
+void itree_destroy(ITree *t, void (*fn)(ITreeNode *node, void *userdata), void *userdata);
@@ -0,0 +1,111 @@
+#include "keymap.h"
+#include "common.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+enum {
+    MIN_NSLOTS = 1024,
+};
+
+static inline uint64_t hash(const char *s, size_t ns)
+{
+    // 64-bit FNV-1a.
+    uint64_t h = 14695981039346656037u;
+    for (size_t i = 0; i < ns; ++i) {
+        h ^= (unsigned char) s[i];
+        h *= 1099511628211u;
+    }
+    return h;
+}
+
+// Returns the slot holding 'key', or the empty slot where it would go.
+static size_t find_slot(const KeyMap *m, const char *key, size_t nkey, uint64_t h)
+{
+    size_t mask = m->nslots - 1;
+    size_t i = h & mask;
+    for (;;) {
+        const KeyMapSlot *slot = &m->slots[i];
+        if (!slot->value)
+            return i;
+        if (slot->hash == h && slot->nkey == nkey && memcmp(slot->key, key, nkey) == 0)
+            return i;
+        i = (i + 1) & mask;
+    }
+}
+
+static void grow_table(KeyMap *m)
+{
+    KeyMapSlot *old_slots = m->slots;
+    size_t old_nslots = m->nslots;
+
+    m->nslots = old_nslots ? old_nslots * 2 : MIN_NSLOTS;
+    m->slots = calloc_or_die(m->nslots, sizeof(KeyMapSlot));
+
+    size_t mask = m->nslots - 1;
+    for (size_t i = 0; i < old_nslots; ++i) {
+        if (!old_slots[i].value)
+            continue;
+        // All the keys are distinct, so only empty slots need to be looked for.
+        size_t j = old_slots[i].hash & mask;
+        while (m->slots[j].value)
+            j = (j + 1) & mask;
+        m->slots[j] = old_slots[i];
+    }
+    free(old_slots);
+}
+
+void *key_map_get(const KeyMap *m, const char *key, size_t nkey)
+{
+    if (!m->size)
+        return NULL;
+    return m->slots[find_slot(m, key, nkey, hash(key, nkey))].value;
+}
+
+void key_map_put(KeyMap *m, const char *key, size_t nkey, void *value)
+{
+    if ((m->size + 1) * 2 > m->nslots)
+        grow_table(m);
+
+    uint64_t h = hash(key, nkey);
+    KeyMapSlot *slot = &m->slots[find_slot(m, key, nkey, h)];
+    if (!slot->value)
+        ++m->size;
+    *slot = (KeyMapSlot) {.key = key, .nkey = nkey, .hash = h, .value = value};
+}
+
+bool key_map_remove(KeyMap *m, const char *key, size_t nkey, void *value)
+{
+    if (!m->size)
+        return false;
+
+    size_t mask = m->nslots - 1;
+    size_t i = find_slot(m, key, nkey, hash(key, nkey));
+    if (m->slots[i].value != value)
+        return false;
+
+    // Move back every following slot of the run that would still be found from its home slot.
+    for (size_t j = (i + 1) & mask; m->slots[j].value; j = (j + 1) & mask) {
+        size_t home = m->slots[j].hash & mask;
+        // Whether 'home' lies cyclically in (i; j].
+        bool stays = i <= j ? (home > i && home <= j) : (home > i || home <= j);
+        if (!stays) {
+            m->slots[i] = m->slots[j];
+            i = j;
+        }
+    }
+    m->slots[i].value = NULL;
+    --m->size;
+    return true;
+}
+
+void key_map_clear(KeyMap *m)
+{
+    free(m->slots);
+    *m = (KeyMap) {0};
+}
+
+size_t key_map_memory(const KeyMap *m)
+{
+    return m->nslots * sizeof(KeyMapSlot);
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// A hash table from byte strings to non-NULL pointers. The keys are not copied: a key must stay
+// valid for as long as it is in the table (normally, it lives in the item it maps to).
+
+typedef struct {
+    const char *key;
+    size_t nkey;
+    uint64_t hash;
+    // NULL denotes an empty slot.
+    void *value;
+} KeyMapSlot;
+
+typedef struct {
+    // Open addressing with linear probing; removals shift the following slots back, so there are no
+    // tombstones. The number of slots is a power of two (or zero).
+    KeyMapSlot *slots;
+    size_t nslots;
+    size_t size;
+} KeyMap;
+
+// Returns the value of 'key', or NULL if there is none.
+void *key_map_get(const KeyMap *m, const char *key, size_t nkey);
+
+// Sets the value of 'key' to 'value', which must not be NULL.
+void key_map_put(KeyMap *m, const char *key, size_t nkey, void *value);
+
+// Removes 'key' if its value is 'value'. Returns whether it has been removed.
+bool key_map_remove(KeyMap *m, const char *key, size_t nkey, void *value);
+
+// Removes all the keys.
+void key_map_clear(KeyMap *m);
+
+// Returns the number of bytes allocated by the table.
+size_t key_map_memory(const KeyMap *m);
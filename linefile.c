@@ -0,0 +1,99 @@
+#include "linefile.h"
+#include "common.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+int line_file_open(LineFile *f, const char *path, char sep, char *err, size_t nerr)
+{
+    *f = (LineFile) {.sep = sep};
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        snprintf(err, nerr, "cannot open: %s", strerror(errno));
+        return -1;
+    }
+    struct stat sb;
+    if (fstat(fd, &sb) < 0) {
+        snprintf(err, nerr, "cannot fstat(): %s", strerror(errno));
+        close(fd);
+        return -1;
+    }
+    f->size = sb.st_size;
+    if (f->size) {
+        void *p = mmap(NULL, f->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED) {
+            snprintf(err, nerr, "cannot mmap(): %s", strerror(errno));
+            close(fd);
+            return -1;
+        }
+        f->data = p;
+    }
+    close(fd);
+    return 0;
+}
+
+static inline void add_record(LineFile *f, size_t from)
+{
+    if (f->nrecords % LINE_FILE_STRIDE == 0) {
+        if (f->ncheckpoints == f->ccheckpoints) {
+            f->checkpoints = x2realloc_or_die(f->checkpoints, &f->ccheckpoints, sizeof(uint64_t));
+        }
+        f->checkpoints[f->ncheckpoints++] = from;
+    }
+    ++f->nrecords;
+}
+
+bool line_file_scan(LineFile *f, size_t nbytes)
+{
+    size_t end = f->size - f->scanned > nbytes ? f->scanned + nbytes : f->size;
+    while (f->scanned < f->size) {
+        size_t from = f->scanned;
+        const char *p = memchr(f->data + from, f->sep, f->size - from);
+        f->scanned = p ? (size_t) (p - f->data) + 1 : f->size;
+        add_record(f, from);
+        if (f->scanned >= end)
+            break;
+    }
+    return line_file_scanned(f);
+}
+
+void line_file_record(LineFile *f, uint64_t idx, const char **s, size_t *ns)
+{
+    size_t from;
+    uint64_t cur;
+    if (idx >= f->last_idx && idx - f->last_idx < LINE_FILE_STRIDE) {
+        from = f->last_from;
+        cur = f->last_idx;
+    } else {
+        from = f->checkpoints[idx / LINE_FILE_STRIDE];
+        cur = idx - idx % LINE_FILE_STRIDE;
+    }
+    for (; cur < idx; ++cur) {
+        const char *p = memchr(f->data + from, f->sep, f->size - from);
+        from = p - f->data + 1;
+    }
+
+    const char *p = memchr(f->data + from, f->sep, f->size - from);
+    size_t to = p ? (size_t) (p - f->data) : f->size;
+    f->last_idx = idx;
+    f->last_from = from;
+
+    *s = f->data + from;
+    *ns = to - from;
+}
+
+void line_file_close(LineFile *f)
+{
+    if (f->data) {
+        munmap((void *) f->data, f->size);
+    }
+    free(f->checkpoints);
+    *f = (LineFile) {0};
+}
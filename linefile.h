@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// A read-only memory-mapped file of records, each terminated by 'sep' (the last one may be
+// unterminated). The records are found by a scan that proceeds in steps, so that the first ones can
+// be shown before the whole file has been looked at; only the offset of every LINE_FILE_STRIDE-th
+// record is kept, and the others are found from there.
+
+enum {
+    LINE_FILE_STRIDE = 64,
+};
+
+typedef struct {
+    const char *data;
+    size_t size;
+    char sep;
+
+    // 'checkpoints[i]' is the offset of record number 'i * LINE_FILE_STRIDE'.
+    uint64_t *checkpoints;
+    size_t ncheckpoints;
+    size_t ccheckpoints;
+
+    // Number of records found so far, and the offset the scan continues from.
+    uint64_t nrecords;
+    size_t scanned;
+
+    // The last record looked up, which makes looking up the next one cheap.
+    uint64_t last_idx;
+    size_t last_from;
+} LineFile;
+
+// Returns -1 on failure and stores an error message into 'err'.
+int line_file_open(LineFile *f, const char *path, char sep, char *err, size_t nerr);
+
+// Scans at least 'nbytes' more bytes (if there are that many), rounded up to the end of a record.
+// Returns whether the whole file has been scanned.
+bool line_file_scan(LineFile *f, size_t nbytes);
+
+static inline bool line_file_scanned(const LineFile *f)
+{
+    return f->scanned == f->size;
+}
+
+// 'idx' must be less than 'f->nrecords'. Stores the bounds of the record, without the separator.
+void line_file_record(LineFile *f, uint64_t idx, const char **s, size_t *ns);
+
+void line_file_close(LineFile *f);
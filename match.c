@@ -0,0 +1,62 @@
+#include "match.h"
+
+#include <string.h>
+
+static inline char ascii_lower(char c)
+{
+    return (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+}
+
+void matcher_init(Matcher *m, const char *s, size_t ns)
+{
+    bool ignore_case = true;
+    for (size_t i = 0; i < ns; ++i) {
+        if (s[i] >= 'A' && s[i] <= 'Z') {
+            ignore_case = false;
+            break;
+        }
+    }
+    *m = (Matcher) {.s = s, .n = ns, .ignore_case = ignore_case};
+}
+
+static bool match_ignore_case(const Matcher *m, const char *text, size_t ntext)
+{
+    const char *s = m->s;
+    size_t n = m->n;
+    char first = s[0];
+    for (size_t i = 0; i + n <= ntext; ++i) {
+        if (ascii_lower(text[i]) != first)
+            continue;
+        size_t j = 1;
+        while (j < n && ascii_lower(text[i + j]) == s[j])
+            ++j;
+        if (j == n)
+            return true;
+    }
+    return false;
+}
+
+static bool match_exact(const Matcher *m, const char *text, size_t ntext)
+{
+    const char *s = m->s;
+    size_t n = m->n;
+    const char *end = text + ntext;
+    while ((size_t) (end - text) >= n) {
+        const char *p = memchr(text, s[0], end - text - n + 1);
+        if (!p)
+            return false;
+        if (memcmp(p + 1, s + 1, n - 1) == 0)
+            return true;
+        text = p + 1;
+    }
+    return false;
+}
+
+bool matcher_match(const Matcher *m, const char *text, size_t ntext)
+{
+    if (!m->n)
+        return true;
+    if (m->ignore_case)
+        return match_ignore_case(m, text, ntext);
+    return match_exact(m, text, ntext);
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// A substring query over raw (undecoded) text. If the query has no uppercase ASCII letters, ASCII
+// letters in the text match regardless of their case.
+typedef struct {
+    const char *s;
+    size_t n;
+    bool ignore_case;
+} Matcher;
+
+// 's' must stay valid for as long as the matcher is used.
+void matcher_init(Matcher *m, const char *s, size_t ns);
+
+bool matcher_match(const Matcher *m, const char *text, size_t ntext);
@@ -0,0 +1,53 @@
+#include "pacer.h"
+
+#include <time.h>
+
+int64_t pacer_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((int64_t) ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+void pacer_event(Pacer *p, int64_t now)
+{
+    if (!p->pending) {
+        p->pending = true;
+        p->first_pending = now;
+    }
+    ++p->nevents;
+}
+
+void pacer_frame(Pacer *p, int64_t now)
+{
+    p->pending = false;
+    p->last_frame = now;
+    ++p->nframes;
+}
+
+static inline int64_t earliest_frame(const Pacer *p)
+{
+    return p->nframes ? p->last_frame + p->min_interval : 0;
+}
+
+bool pacer_must_render(const Pacer *p, int64_t now)
+{
+    if (!p->pending)
+        return false;
+    int64_t deadline = p->first_pending + p->budget;
+    int64_t earliest = earliest_frame(p);
+    if (deadline < earliest)
+        deadline = earliest;
+    return now >= deadline;
+}
+
+int pacer_timeout(const Pacer *p, int64_t now)
+{
+    if (!p->pending)
+        return -1;
+    int64_t left = earliest_frame(p) - now;
+    if (left <= 0)
+        return 0;
+    // Round up, so that we do not wake up right before the frame is allowed.
+    return (left + 999999) / 1000000;
+}
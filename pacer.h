@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Decides when to render a frame. Events (packs and keystrokes) are drained as long as more of them
+// are immediately available; the accumulated state is rendered once the input runs dry, or once
+// 'budget' nanoseconds have passed since the first event that has not been rendered yet, whichever
+// comes first. In either case, two frames are never rendered closer than 'min_interval' nanoseconds
+// apart, but a pending frame is always rendered eventually.
+//
+// All the times are in nanoseconds, as returned by 'pacer_now()'.
+typedef struct {
+    // Zero means no limit.
+    int64_t min_interval;
+    int64_t budget;
+
+    int64_t last_frame;
+    bool pending;
+    int64_t first_pending;
+
+    // Number of frames rendered and of events handled so far.
+    uint64_t nframes;
+    uint64_t nevents;
+} Pacer;
+
+// Returns the current time of the monotonic clock.
+int64_t pacer_now(void);
+
+// Records that an event has been handled at 'now'.
+void pacer_event(Pacer *p, int64_t now);
+
+// Records that a frame has been rendered at 'now'.
+void pacer_frame(Pacer *p, int64_t now);
+
+// Returns whether a pending frame must be rendered now, even if more events are available.
+bool pacer_must_render(const Pacer *p, int64_t now);
+
+// Returns the timeout (in milliseconds, as accepted by 'poll()') to wait for more events for: -1 if
+// no frame is pending; otherwise, the time left until a frame may be rendered. If no events arrive
+// within the timeout, the pending frame should be rendered.
+int pacer_timeout(const Pacer *p, int64_t now);
@@ -0,0 +1,121 @@
+#include "pool.h"
+#include "common.h"
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+struct Pool {
+    pthread_t *threads;
+    size_t nthreads;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t start_cond;
+    pthread_cond_t done_cond;
+
+    // Incremented every time a job is posted.
+    uint64_t generation;
+    // Number of workers that have not finished the current job yet.
+    size_t nbusy;
+
+    // The current job.
+    void (*fn)(void *userdata, size_t from, size_t to);
+    void *userdata;
+    size_t n;
+    size_t chunk;
+    atomic_size_t next;
+};
+
+static void do_work(Pool *p)
+{
+    for (;;) {
+        size_t from = atomic_fetch_add_explicit(&p->next, p->chunk, memory_order_relaxed);
+        if (from >= p->n)
+            break;
+        size_t to = p->n - from > p->chunk ? from + p->chunk : p->n;
+        p->fn(p->userdata, from, to);
+    }
+}
+
+static void *worker_main(void *arg)
+{
+    Pool *p = arg;
+    uint64_t seen = 0;
+
+    pthread_mutex_lock(&p->mutex);
+    for (;;) {
+        while (p->generation == seen)
+            pthread_cond_wait(&p->start_cond, &p->mutex);
+        seen = p->generation;
+        pthread_mutex_unlock(&p->mutex);
+
+        do_work(p);
+
+        pthread_mutex_lock(&p->mutex);
+        if (--p->nbusy == 0)
+            pthread_cond_signal(&p->done_cond);
+    }
+    return NULL;
+}
+
+Pool *pool_new(size_t nthreads)
+{
+    Pool *p = malloc_or_die(1, sizeof(Pool));
+    *p = (Pool) {
+        .threads = malloc_or_die(nthreads, sizeof(pthread_t)),
+    };
+    pthread_mutex_init(&p->mutex, NULL);
+    pthread_cond_init(&p->start_cond, NULL);
+    pthread_cond_init(&p->done_cond, NULL);
+    atomic_init(&p->next, 0);
+
+    // Signals must keep being delivered to the main thread, whose poll() they are meant to wake up.
+    sigset_t all;
+    sigset_t old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+
+    for (size_t i = 1; i < nthreads; ++i) {
+        int r = pthread_create(&p->threads[p->nthreads], NULL, worker_main, p);
+        if (r != 0) {
+            // Make do with what we have.
+            break;
+        }
+        ++p->nthreads;
+    }
+
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    return p;
+}
+
+void pool_run(Pool *p, size_t n, size_t chunk, void (*fn)(void *userdata, size_t from, size_t to), void *userdata)
+{
+    if (!chunk)
+        chunk = 1;
+
+    if (!p->nthreads || n <= chunk) {
+        for (size_t from = 0; from < n; from += chunk)
+            fn(userdata, from, n - from > chunk ? from + chunk : n);
+        return;
+    }
+
+    pthread_mutex_lock(&p->mutex);
+    p->fn = fn;
+    p->userdata = userdata;
+    p->n = n;
+    p->chunk = chunk;
+    atomic_store_explicit(&p->next, 0, memory_order_relaxed);
+    p->nbusy = p->nthreads;
+    ++p->generation;
+    pthread_cond_broadcast(&p->start_cond);
+    pthread_mutex_unlock(&p->mutex);
+
+    do_work(p);
+
+    pthread_mutex_lock(&p->mutex);
+    while (p->nbusy)
+        pthread_cond_wait(&p->done_cond, &p->mutex);
+    pthread_mutex_unlock(&p->mutex);
+}
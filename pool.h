@@ -0,0 +1,15 @@
+#pragma once
+
+#include <stddef.h>
+
+// A fixed set of worker threads that split loops over [0; n) between themselves and the calling
+// thread.
+typedef struct Pool Pool;
+
+// Starts 'nthreads' - 1 worker threads (the calling thread does its share of the work, too). The
+// workers have all the signals blocked.
+Pool *pool_new(size_t nthreads);
+
+// Calls 'fn(userdata, from, to)' on consecutive chunks of at most 'chunk' elements that together
+// cover [0; n), possibly in parallel, and waits for all of them to finish.
+void pool_run(Pool *p, size_t n, size_t chunk, void (*fn)(void *userdata, size_t from, size_t to), void *userdata);
@@ -0,0 +1,208 @@
+#include "snapshot.h"
+#include "common.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static const char MAGIC[8] = {'c', 'm', 'e', 'n', 'u', 's', 'n', 'p'};
+
+static inline size_t span_size(size_t n)
+{
+    // The length, the bytes and the null byte, rounded up to a multiple of 8.
+    return sizeof(uint64_t) + ((n + 1 + 7) & ~(size_t) 7);
+}
+
+int snapshot_open(Snapshot *s, const char *path, char *err, size_t nerr)
+{
+    *s = (Snapshot) {0};
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        snprintf(err, nerr, "cannot open: %s", strerror(errno));
+        return -1;
+    }
+    struct stat sb;
+    if (fstat(fd, &sb) < 0) {
+        snprintf(err, nerr, "cannot fstat(): %s", strerror(errno));
+        close(fd);
+        return -1;
+    }
+    if ((size_t) sb.st_size < sizeof(SnapshotHeader)) {
+        snprintf(err, nerr, "not a snapshot (too short)");
+        close(fd);
+        return -1;
+    }
+    s->size = sb.st_size;
+    void *p = mmap(NULL, s->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        snprintf(err, nerr, "cannot mmap(): %s", strerror(errno));
+        return -1;
+    }
+    s->data = p;
+
+    memcpy(&s->header, s->data, sizeof(SnapshotHeader));
+    const SnapshotHeader *h = &s->header;
+    if (memcmp(h->magic, MAGIC, sizeof(MAGIC)) != 0) {
+        snprintf(err, nerr, "not a snapshot");
+        goto fail;
+    }
+    if (h->byte_order != SNAPSHOT_BYTE_ORDER) {
+        snprintf(err, nerr, "written on a machine with another byte order");
+        goto fail;
+    }
+    if (h->version != SNAPSHOT_VERSION) {
+        snprintf(err, nerr, "unsupported version %u (expected %d)", (unsigned) h->version, SNAPSHOT_VERSION);
+        goto fail;
+    }
+    if (!h->ncols) {
+        snprintf(err, nerr, "no columns");
+        goto fail;
+    }
+    if (h->table > s->size || h->nentries > (s->size - h->table) / sizeof(uint64_t)) {
+        snprintf(err, nerr, "truncated");
+        goto fail;
+    }
+
+    s->pos = sizeof(SnapshotHeader);
+    s->columns = malloc_or_die(h->ncols, sizeof(const char *));
+    for (uint32_t i = 0; i < h->ncols; ++i) {
+        size_t n;
+        if (snapshot_read_span(s, &s->columns[i], &n) < 0) {
+            snprintf(err, nerr, "truncated");
+            goto fail;
+        }
+    }
+    return 0;
+
+fail:
+    free(s->columns);
+    munmap((void *) s->data, s->size);
+    *s = (Snapshot) {0};
+    return -1;
+}
+
+int snapshot_read_span(Snapshot *s, const char **p, size_t *n)
+{
+    size_t left = s->size - s->pos;
+    if (left < sizeof(uint64_t))
+        return -1;
+    uint64_t len;
+    memcpy(&len, s->data + s->pos, sizeof(len));
+    if (len >= left - sizeof(uint64_t) || span_size(len) > left)
+        return -1;
+    const char *start = s->data + s->pos + sizeof(uint64_t);
+    if (start[len] != '\0')
+        return -1;
+    *p = start;
+    *n = len;
+    s->pos += span_size(len);
+    return 0;
+}
+
+int snapshot_seek_entry(Snapshot *s, uint64_t idx)
+{
+    uint64_t off;
+    memcpy(&off, s->data + s->header.table + idx * sizeof(uint64_t), sizeof(off));
+    if (off < sizeof(SnapshotHeader) || off > s->header.table)
+        return -1;
+    s->pos = off;
+    return 0;
+}
+
+void snapshot_close(Snapshot *s)
+{
+    if (s->data) {
+        munmap((void *) s->data, s->size);
+    }
+    free(s->columns);
+    *s = (Snapshot) {0};
+}
+
+int snapshot_write_begin(SnapshotWriter *w, const char *path, const SnapshotHeader *h, const char *const *columns)
+{
+    size_t npath = strlen(path);
+    *w = (SnapshotWriter) {
+        .path = path,
+        .tmp_path = malloc_or_die(npath + 5, 1),
+        .header = *h,
+    };
+    memcpy(w->tmp_path, path, npath);
+    memcpy(w->tmp_path + npath, ".tmp", 5);
+
+    w->f = fopen(w->tmp_path, "wb");
+    if (!w->f) {
+        free(w->tmp_path);
+        return -1;
+    }
+    SnapshotHeader *header = &w->header;
+    memcpy(header->magic, MAGIC, sizeof(MAGIC));
+    header->version = SNAPSHOT_VERSION;
+    header->byte_order = SNAPSHOT_BYTE_ORDER;
+    // Written again once the entries are known.
+    fwrite(header, sizeof(*header), 1, w->f);
+    w->pos = sizeof(*header);
+    for (uint32_t i = 0; i < h->ncols; ++i) {
+        snapshot_write_span(w, columns[i], strlen(columns[i]));
+    }
+    return 0;
+}
+
+void snapshot_write_entry(SnapshotWriter *w)
+{
+    if (w->noffsets == w->coffsets) {
+        w->offsets = x2realloc_or_die(w->offsets, &w->coffsets, sizeof(uint64_t));
+    }
+    w->offsets[w->noffsets++] = w->pos;
+}
+
+void snapshot_write_span(SnapshotWriter *w, const char *p, size_t n)
+{
+    static const char zeros[8] = {0};
+    uint64_t len = n;
+    fwrite(&len, sizeof(len), 1, w->f);
+    fwrite(p, 1, n, w->f);
+    fwrite(zeros, 1, span_size(n) - sizeof(uint64_t) - n, w->f);
+    w->pos += span_size(n);
+}
+
+int snapshot_write_end(SnapshotWriter *w)
+{
+    w->header.nentries = w->noffsets;
+    w->header.table = w->pos;
+    fwrite(w->offsets, sizeof(uint64_t), w->noffsets, w->f);
+    free(w->offsets);
+
+    // The data must be on disk before the file gets the final name, or a crash could leave a
+    // truncated snapshot there.
+    int r = 0;
+    if (ferror(w->f)) {
+        errno = EIO;
+        r = -1;
+    } else if (fseek(w->f, 0, SEEK_SET) != 0 || fwrite(&w->header, sizeof(w->header), 1, w->f) != 1
+               || fflush(w->f) != 0 || fsync(fileno(w->f)) < 0) {
+        r = -1;
+    }
+    if (r < 0) {
+        int saved = errno;
+        fclose(w->f);
+        errno = saved;
+    } else if (fclose(w->f) != 0) {
+        r = -1;
+    }
+    if (r == 0) {
+        r = rename(w->tmp_path, w->path);
+    }
+    if (r < 0) {
+        int saved = errno;
+        unlink(w->tmp_path);
+        errno = saved;
+    }
+    free(w->tmp_path);
+    return r;
+}
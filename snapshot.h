@@ -0,0 +1,97 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// A snapshot of a list (see '-save-snapshot=' and '-load-snapshot='): the column arguments, the
+// entries and the selection. A snapshot is memory-mapped when loaded, and every cell is stored with
+// its length and a terminating null byte, so that the entries point right into the mapping: loading
+// an entry takes no parsing, decoding or copying of its text.
+//
+// The file is a SnapshotHeader, then NCOLS column arguments, then NENTRIES entries, each being the
+// key (if the list is keyed) and then NCOLS cells, and then the table of entries: NENTRIES uint64_t
+// offsets of the entries in the file, so that any entry can be found without looking at the ones
+// before it. Every argument, key and cell is a span: a uint64_t length, the bytes, a null byte, and
+// padding up to a multiple of 8 bytes. Numbers are stored in the byte order of the machine that wrote
+// the file; a file written with another byte order is rejected.
+
+enum {
+    SNAPSHOT_VERSION = 2,
+    SNAPSHOT_BYTE_ORDER = 0x01020304,
+};
+
+enum {
+    // The entries have keys.
+    SNAPSHOT_KEYED = 1,
+};
+
+typedef struct {
+    // "cmenusnp".
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t ncols;
+    uint32_t flags;
+    uint64_t nentries;
+    // Position of the selected entry in the list, or UINT64_MAX if the list is empty.
+    uint64_t selected;
+    // Offset of the table of entries.
+    uint64_t table;
+} SnapshotHeader;
+
+typedef struct {
+    const char *data;
+    size_t size;
+    SnapshotHeader header;
+
+    // The column arguments; valid indices are [0; header.ncols). Null-terminated.
+    const char **columns;
+
+    // Where the next span starts, and the number of entries read so far.
+    size_t pos;
+    uint64_t nread;
+} Snapshot;
+
+// Maps the file and reads the header and the column arguments. Returns -1 on failure and stores an
+// error message into 'err'.
+int snapshot_open(Snapshot *s, const char *path, char *err, size_t nerr);
+
+// Reads the next span. Returns -1 if the file ends before it does.
+int snapshot_read_span(Snapshot *s, const char **p, size_t *n);
+
+// Makes entry number 'idx' (which must be less than 'header.nentries') the next one to be read.
+// Returns -1 if its offset is out of the file.
+int snapshot_seek_entry(Snapshot *s, uint64_t idx);
+
+// Unmaps the file. Nothing read from it (the column arguments included) may be used afterwards.
+void snapshot_close(Snapshot *s);
+
+typedef struct {
+    FILE *f;
+    const char *path;
+    // 'path' with ".tmp" appended; the snapshot is written there and then renamed to 'path'.
+    char *tmp_path;
+
+    SnapshotHeader header;
+    // Number of bytes written so far, and the offsets of the entries.
+    uint64_t pos;
+    uint64_t *offsets;
+    size_t noffsets;
+    size_t coffsets;
+} SnapshotWriter;
+
+// Starts writing a snapshot with the columns, flags and selection of 'h' (the rest of it is filled in
+// by 'snapshot_write_end()'). Returns -1 on failure (with errno set).
+int snapshot_write_begin(SnapshotWriter *w, const char *path, const SnapshotHeader *h, const char *const *columns);
+
+// Starts an entry; its spans follow.
+void snapshot_write_entry(SnapshotWriter *w);
+
+void snapshot_write_span(SnapshotWriter *w, const char *p, size_t n);
+
+// Writes the table of entries (and the number of entries into the header), syncs the file to disk,
+// and replaces the file at 'path' with it. Returns -1 on failure (with errno set), in which case the
+// old file is left alone.
+int snapshot_write_end(SnapshotWriter *w);
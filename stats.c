@@ -0,0 +1,53 @@
+#include "stats.h"
+
+Stats *global_stats;
+
+static size_t bucket_of(uint64_t us)
+{
+    if (us < HISTOGRAM_NSUB)
+        return us;
+    // 'us' is in [2^e; 2^(e+1)), and the three bits after the leading one pick the part.
+    int e = 3;
+    while (us >> (e + 1))
+        ++e;
+    size_t b = (size_t) (e - 2) * HISTOGRAM_NSUB + ((us >> (e - 3)) & (HISTOGRAM_NSUB - 1));
+    return b < HISTOGRAM_NBUCKETS ? b : HISTOGRAM_NBUCKETS - 1;
+}
+
+uint64_t histogram_bucket_start(size_t b)
+{
+    if (b < HISTOGRAM_NSUB)
+        return b;
+    int e = b / HISTOGRAM_NSUB + 2;
+    uint64_t part = b % HISTOGRAM_NSUB;
+    return (HISTOGRAM_NSUB + part) << (e - 3);
+}
+
+void histogram_add(Histogram *h, int64_t ns)
+{
+    uint64_t us = ns > 0 ? ns / 1000 : 0;
+    ++h->buckets[bucket_of(us)];
+    ++h->count;
+    if (ns > h->max) {
+        h->max = ns;
+    }
+}
+
+uint64_t histogram_percentile(const Histogram *h, double p)
+{
+    if (!h->count)
+        return 0;
+    uint64_t rank = h->count * p / 100;
+    if (rank >= h->count)
+        rank = h->count - 1;
+    uint64_t max_us = h->max / 1000;
+    uint64_t seen = 0;
+    for (size_t b = 0; b < HISTOGRAM_NBUCKETS; ++b) {
+        seen += h->buckets[b];
+        if (seen > rank) {
+            uint64_t end = histogram_bucket_start(b + 1);
+            return end - 1 < max_us ? end - 1 : max_us;
+        }
+    }
+    return max_us;
+}
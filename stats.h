@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Runtime statistics (see '-stats-fd='). Everything is counted only if 'global_stats' is not NULL,
+// so that the counting costs a single well-predicted branch when the statistics are off.
+
+enum {
+    // Every power of two is split into HISTOGRAM_NSUB buckets, up to 2^HISTOGRAM_NPOWERS.
+    HISTOGRAM_NSUB = 8,
+    HISTOGRAM_NPOWERS = 40,
+    HISTOGRAM_NBUCKETS = HISTOGRAM_NSUB * HISTOGRAM_NPOWERS,
+};
+
+// Durations in microseconds, in buckets that are exact below HISTOGRAM_NSUB and then split every
+// power of two into HISTOGRAM_NSUB equal parts, so that each bucket is within 1/HISTOGRAM_NSUB of
+// its values (like HdrHistogram, with three significant bits).
+typedef struct {
+    uint64_t buckets[HISTOGRAM_NBUCKETS];
+    uint64_t count;
+    int64_t max;
+} Histogram;
+
+// 'ns' is in nanoseconds.
+void histogram_add(Histogram *h, int64_t ns);
+
+// Returns the least value (in microseconds) of bucket 'b'.
+uint64_t histogram_bucket_start(size_t b);
+
+// Returns the upper bound (in microseconds) of the bucket that holds the 'p'-th percentile, but no
+// more than the maximum; or 0 if the histogram is empty.
+uint64_t histogram_percentile(const Histogram *h, double p);
+
+typedef struct {
+    // Number of packs applied in full, and of commands by their opcode (see 'PROTOCOL.md').
+    uint64_t npacks;
+    uint64_t ncommands[128];
+
+    // Bytes of cells decoded for drawing.
+    uint64_t ndecoded;
+
+    // Calls to the '*_or_die()' allocators.
+    uint64_t nallocs;
+
+    Histogram redraw;
+
+    // From the first keystroke that has not been shown yet (0 if none) to the end of the frame that
+    // shows it.
+    int64_t key_pending_since;
+    Histogram key_to_frame;
+} Stats;
+
+extern Stats *global_stats;
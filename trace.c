@@ -0,0 +1,76 @@
+#include "trace.h"
+#include "common.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+
+Tracer *global_tracer;
+
+void tracer_init(Tracer *t)
+{
+    *t = (Tracer) {
+        .events = malloc_or_die(TRACE_NEVENTS, sizeof(TraceEvent)),
+        .started = pacer_now(),
+    };
+}
+
+void trace_record(const char *name, int64_t start, int64_t end, TraceTrack track)
+{
+    Tracer *t = global_tracer;
+    t->events[t->nevents++ % TRACE_NEVENTS] = (TraceEvent) {
+        .name = name,
+        .start = start,
+        .dur = end - start,
+        .track = track,
+    };
+}
+
+static void write_histogram(FILE *f, const char *name, const Histogram *h)
+{
+    fprintf(f, "\"%s\": {\"count\": %llu", name, (unsigned long long) h->count);
+    const double ps[] = {50, 90, 99, 99.9};
+    const char *pnames[] = {"p50", "p90", "p99", "p999"};
+    for (size_t i = 0; i < sizeof(ps) / sizeof(ps[0]); ++i) {
+        fprintf(f, ", \"%s\": %llu", pnames[i], (unsigned long long) histogram_percentile(h, ps[i]));
+    }
+    fprintf(f, ", \"max\": %llu, \"buckets\": [", (unsigned long long) (h->max / 1000));
+    // The non-empty buckets, as [the least value, count].
+    bool first = true;
+    for (size_t b = 0; b < HISTOGRAM_NBUCKETS; ++b) {
+        if (!h->buckets[b])
+            continue;
+        fprintf(f, "%s[%llu, %llu]", first ? "" : ", ", (unsigned long long) histogram_bucket_start(b),
+                (unsigned long long) h->buckets[b]);
+        first = false;
+    }
+    fprintf(f, "]}");
+}
+
+int tracer_write(const Tracer *t, const char *path)
+{
+    FILE *f = fopen(path, "w");
+    if (!f)
+        return -1;
+
+    fprintf(f, "{\"traceEvents\": [\n");
+    fprintf(f, "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"args\": {\"name\": \"main\"}},\n", TRACK_MAIN);
+    fprintf(f, "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"args\": {\"name\": \"packs\"}}", TRACK_PACKS);
+    uint64_t from = t->nevents > TRACE_NEVENTS ? t->nevents - TRACE_NEVENTS : 0;
+    for (uint64_t i = from; i < t->nevents; ++i) {
+        const TraceEvent *e = &t->events[i % TRACE_NEVENTS];
+        fprintf(f, ",\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f}",
+                e->name, e->track, (e->start - t->started) / 1e3, e->dur / 1e3);
+    }
+    fprintf(f, "\n], \"displayTimeUnit\": \"ms\", \"droppedEvents\": %llu, \"histograms\": {",
+            (unsigned long long) from);
+    write_histogram(f, "key_to_refresh_us", &t->key_to_refresh);
+    fprintf(f, ", ");
+    write_histogram(f, "pack_to_ack_us", &t->pack_to_ack);
+    fprintf(f, "}}\n");
+
+    if (ferror(f)) {
+        fclose(f);
+        return -1;
+    }
+    return fclose(f);
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "pacer.h"
+#include "stats.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Tracing of where the time goes (see '-trace='). Spans are recorded only if 'global_tracer' is
+// not NULL. Only the main thread records spans, so the buffer needs no locking: it is a ring of the
+// last TRACE_NEVENTS spans, allocated up front, and recording a span never allocates.
+
+enum {
+    TRACE_NEVENTS = 1 << 20,
+};
+
+// Spans on the same track nest; a pack is applied in steps with other work in between, so packs
+// have a track of their own.
+typedef enum {
+    TRACK_MAIN = 1,
+    TRACK_PACKS = 2,
+} TraceTrack;
+
+typedef struct {
+    // A string literal.
+    const char *name;
+    int64_t start;
+    int64_t dur;
+    TraceTrack track;
+} TraceEvent;
+
+typedef struct {
+    TraceEvent *events;
+    // Total number of spans recorded; the last TRACE_NEVENTS of them are kept.
+    uint64_t nevents;
+    int64_t started;
+
+    // From a keystroke to the end of the refresh() that shows it, and from the arrival of the header
+    // of a pack to its acknowledgement.
+    int64_t key_pending_since;
+    Histogram key_to_refresh;
+    Histogram pack_to_ack;
+} Tracer;
+
+extern Tracer *global_tracer;
+
+void tracer_init(Tracer *t);
+
+// Returns the start of a span, or 0 if nothing is being traced.
+static inline int64_t trace_begin(void)
+{
+    return global_tracer ? pacer_now() : 0;
+}
+
+void trace_record(const char *name, int64_t start, int64_t end, TraceTrack track);
+
+// Ends a span of the main track that has been started by 'trace_begin()'.
+static inline void trace_end(const char *name, int64_t start)
+{
+    if (global_tracer) {
+        trace_record(name, start, pacer_now(), TRACK_MAIN);
+    }
+}
+
+// Writes the spans as a Chrome trace-event JSON file (that chrome://tracing and Perfetto open),
+// with the histograms in an extra "histograms" key. Returns -1 on error (with errno set).
+int tracer_write(const Tracer *t, const char *path);
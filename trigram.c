@@ -0,0 +1,233 @@
+#include "trigram.h"
+#include "common.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+enum {
+    MIN_NSLOTS = 1024,
+    // Purge the posting lists once there are at least this many dead ids, and more dead ids than
+    // live ones.
+    MIN_NDEAD_TO_SWEEP = 4096,
+};
+
+static inline uint32_t lower(unsigned char c)
+{
+    return (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+}
+
+static inline uint32_t trigram_at(const char *s)
+{
+    return (lower(s[0]) << 16) | (lower(s[1]) << 8) | lower(s[2]);
+}
+
+static inline size_t hash(uint32_t x)
+{
+    // The finalizer of MurmurHash3.
+    x ^= x >> 16;
+    x *= 0x85EBCA6Bu;
+    x ^= x >> 13;
+    x *= 0xC2B2AE35u;
+    x ^= x >> 16;
+    return x;
+}
+
+static size_t find_slot(const TrigramIndex *ix, uint32_t key)
+{
+    size_t mask = ix->nslots - 1;
+    size_t i = hash(key) & mask;
+    while (ix->keys[i] && ix->keys[i] != key)
+        i = (i + 1) & mask;
+    return i;
+}
+
+static void grow_table(TrigramIndex *ix)
+{
+    uint32_t *old_keys = ix->keys;
+    TrigramPosting *old_postings = ix->postings;
+    size_t old_nslots = ix->nslots;
+
+    ix->nslots = old_nslots ? old_nslots * 2 : MIN_NSLOTS;
+    ix->keys = calloc_or_die(ix->nslots, sizeof(uint32_t));
+    ix->postings = malloc_or_die(ix->nslots, sizeof(TrigramPosting));
+
+    for (size_t i = 0; i < old_nslots; ++i) {
+        if (old_keys[i]) {
+            size_t j = find_slot(ix, old_keys[i]);
+            ix->keys[j] = old_keys[i];
+            ix->postings[j] = old_postings[i];
+        }
+    }
+    free(old_keys);
+    free(old_postings);
+}
+
+// Returns NULL if there is no such posting list and 'create' is false.
+static TrigramPosting *posting_of(TrigramIndex *ix, uint32_t trigram, bool create)
+{
+    uint32_t key = trigram + 1;
+    if (!ix->nslots) {
+        if (!create)
+            return NULL;
+        grow_table(ix);
+    }
+    size_t i = find_slot(ix, key);
+    if (ix->keys[i])
+        return &ix->postings[i];
+    if (!create)
+        return NULL;
+
+    if ((ix->nused + 1) * 2 > ix->nslots) {
+        grow_table(ix);
+        i = find_slot(ix, key);
+    }
+    ix->keys[i] = key;
+    ix->postings[i] = (TrigramPosting) {0};
+    ++ix->nused;
+    return &ix->postings[i];
+}
+
+static inline void push_u32(uint32_t **p, size_t *n, size_t *c, uint32_t x)
+{
+    if (*n == *c) {
+        *p = x2realloc_or_die(*p, c, sizeof(uint32_t));
+    }
+    (*p)[(*n)++] = x;
+}
+
+void trigram_index_feed(TrigramIndex *ix, const char *s, size_t ns)
+{
+    for (size_t i = 0; i + 3 <= ns; ++i)
+        push_u32(&ix->pending, &ix->npending, &ix->cpending, trigram_at(s + i));
+}
+
+uint32_t trigram_index_commit(TrigramIndex *ix, void *item)
+{
+    uint32_t id;
+    if (ix->nfree) {
+        id = ix->free_ids[--ix->nfree];
+    } else {
+        if (!ix->nitems)
+            ix->nitems = 1;
+        while (ix->nitems >= ix->citems) {
+            ix->items = x2realloc_or_die(ix->items, &ix->citems, sizeof(void *));
+        }
+        id = ix->nitems++;
+    }
+    ix->items[id] = item;
+    ++ix->nlive;
+
+    for (size_t i = 0; i < ix->npending; ++i) {
+        TrigramPosting *p = posting_of(ix, ix->pending[i], true);
+        // An item is mentioned at most once in every posting list; if this trigram has already been
+        // seen in this item, this item is the last one in the list.
+        if (p->size && p->ids[p->size - 1] == id)
+            continue;
+        if (p->size == p->capacity) {
+            size_t capacity = p->capacity;
+            p->ids = x2realloc_or_die(p->ids, &capacity, sizeof(uint32_t));
+            p->capacity = capacity;
+        }
+        p->ids[p->size++] = id;
+    }
+    ix->npending = 0;
+
+    return id;
+}
+
+static void sweep(TrigramIndex *ix)
+{
+    for (size_t i = 0; i < ix->nslots; ++i) {
+        if (!ix->keys[i])
+            continue;
+        TrigramPosting *p = &ix->postings[i];
+        uint32_t n = 0;
+        for (uint32_t j = 0; j < p->size; ++j) {
+            if (ix->items[p->ids[j]])
+                p->ids[n++] = p->ids[j];
+        }
+        p->size = n;
+        if (!n) {
+            free(p->ids);
+            *p = (TrigramPosting) {0};
+        }
+    }
+
+    for (size_t i = 0; i < ix->ndead; ++i)
+        push_u32(&ix->free_ids, &ix->nfree, &ix->cfree, ix->dead[i]);
+    ix->ndead = 0;
+}
+
+void trigram_index_remove(TrigramIndex *ix, uint32_t id)
+{
+    ix->items[id] = NULL;
+    --ix->nlive;
+    push_u32(&ix->dead, &ix->ndead, &ix->cdead, id);
+
+    if (ix->ndead >= MIN_NDEAD_TO_SWEEP && ix->ndead > ix->nlive) {
+        sweep(ix);
+    }
+}
+
+void trigram_index_clear(TrigramIndex *ix)
+{
+    for (size_t i = 0; i < ix->nslots; ++i) {
+        if (ix->keys[i])
+            free(ix->postings[i].ids);
+    }
+    free(ix->keys);
+    free(ix->postings);
+    free(ix->items);
+    free(ix->dead);
+    free(ix->free_ids);
+    free(ix->pending);
+    free(ix->result);
+    *ix = (TrigramIndex) {0};
+}
+
+bool trigram_index_lookup(TrigramIndex *ix, const char *q, size_t nq, void ***pitems, size_t *nitems)
+{
+    if (nq < 3)
+        return false;
+
+    // Only the shortest posting list is looked at.
+    const TrigramPosting *best = NULL;
+    for (size_t i = 0; i + 3 <= nq; ++i) {
+        const TrigramPosting *p = posting_of(ix, trigram_at(q + i), false);
+        if (!p || !p->size) {
+            *pitems = ix->result;
+            *nitems = 0;
+            return true;
+        }
+        if (!best || p->size < best->size)
+            best = p;
+    }
+
+    if (ix->cresult < best->size) {
+        ix->cresult = best->size;
+        ix->result = realloc_or_die(ix->result, ix->cresult, sizeof(void *));
+    }
+    size_t n = 0;
+    for (uint32_t j = 0; j < best->size; ++j) {
+        void *item = ix->items[best->ids[j]];
+        if (item)
+            ix->result[n++] = item;
+    }
+
+    *pitems = ix->result;
+    *nitems = n;
+    return true;
+}
+
+size_t trigram_index_memory(const TrigramIndex *ix)
+{
+    size_t r = ix->nslots * (sizeof(uint32_t) + sizeof(TrigramPosting));
+    for (size_t i = 0; i < ix->nslots; ++i) {
+        if (ix->keys[i])
+            r += ix->postings[i].capacity * sizeof(uint32_t);
+    }
+    r += ix->citems * sizeof(void *);
+    r += (ix->cdead + ix->cfree + ix->cpending) * sizeof(uint32_t);
+    r += ix->cresult * sizeof(void *);
+    return r;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// An inverted index from the trigrams (three consecutive bytes, with ASCII letters lowercased) of
+// some texts to the items these texts belong to. A lookup returns a superset of the items with a
+// text that contains the query (ignoring the case of ASCII letters); the caller has to check them.
+//
+// Items are given ids when added. Removing an item only marks its id as dead; the posting lists are
+// purged of dead ids (and the ids become free for reuse) in bulk, once there are enough of them.
+
+typedef struct {
+    uint32_t *ids;
+    uint32_t size;
+    uint32_t capacity;
+} TrigramPosting;
+
+typedef struct {
+    // Open-addressing hash table from trigrams to their posting lists. A key is a trigram plus one;
+    // zero denotes an empty slot. The number of slots is a power of two (or zero).
+    uint32_t *keys;
+    TrigramPosting *postings;
+    size_t nslots;
+    size_t nused;
+
+    // Items by id; NULL for dead and free ids. Id zero is never used.
+    void **items;
+    size_t nitems;
+    size_t citems;
+    size_t nlive;
+
+    // Dead ids, which may still be mentioned in posting lists.
+    uint32_t *dead;
+    size_t ndead;
+    size_t cdead;
+
+    // Ids that can be given out again.
+    uint32_t *free_ids;
+    size_t nfree;
+    size_t cfree;
+
+    // Trigrams of the item being added.
+    uint32_t *pending;
+    size_t npending;
+    size_t cpending;
+
+    // The result of the last lookup.
+    void **result;
+    size_t cresult;
+} TrigramIndex;
+
+// Adds the trigrams of 's' to the item being added.
+void trigram_index_feed(TrigramIndex *ix, const char *s, size_t ns);
+
+// Adds an item with the trigrams fed since the last call and returns its id, which is never zero.
+uint32_t trigram_index_commit(TrigramIndex *ix, void *item);
+
+void trigram_index_remove(TrigramIndex *ix, uint32_t id);
+
+// Removes all the items.
+void trigram_index_clear(TrigramIndex *ix);
+
+// Returns false if 'q' is too short to be looked up. Otherwise, stores a pointer to the candidate
+// items (valid until the next call on 'ix') to '*pitems' and their number to '*nitems'.
+bool trigram_index_lookup(TrigramIndex *ix, const char *q, size_t nq, void ***pitems, size_t *nitems);
+
+// Returns the number of bytes allocated by the index.
+size_t trigram_index_memory(const TrigramIndex *ix);
@@ -1,28 +1,66 @@
 #include "truncated_text.h"
+#include "utf8.h"
 
-void truncate_text_to_width(TruncatedText *t, uint32_t width)
+bool truncated_text_prepare(TruncatedText *t, uint32_t *widths)
 {
-    if (t->target_width == width)
-        return;
-
     wchar_t *s = t->s;
     size_t n = t->n;
 
-    uint64_t cur_w = 0;
-    size_t i = 0;
+    uint32_t cur_w = 0;
+    bool uniform = true;
 
-    for (; i < n; ++i) {
-        int w = wcwidth(s[i]);
+    for (size_t i = 0; i < n; ++i) {
+        wchar_t c = s[i];
+        int w = (c >= 0x20 && c < 0x7F) ? 1 : utf8_wcwidth(c);
         if (w < 0) {
             s[i] = L'.';
             w = 1;
         }
+        if (w != 1) {
+            uniform = false;
+        }
         cur_w += w;
-        if (cur_w > width) {
-            break;
+        widths[i] = cur_w;
+    }
+
+    return uniform;
+}
+
+uint32_t text_width(const wchar_t *s, size_t n)
+{
+    uint32_t w = 0;
+    for (size_t i = 0; i < n; ++i) {
+        wchar_t c = s[i];
+        int cw = (c >= 0x20 && c < 0x7F) ? 1 : utf8_wcwidth(c);
+        w += cw < 0 ? 1 : cw;
+    }
+    return w;
+}
+
+void truncate_text_to_width(TruncatedText *t, uint32_t width)
+{
+    if (t->target_width == width)
+        return;
+
+    const uint32_t *widths = t->widths;
+    size_t n = t->n;
+
+    if (!widths) {
+        t->truncated_n = n < width ? n : width;
+    } else {
+        // Find the number of leading characters whose total width does not exceed 'width'.
+        size_t lo = 0;
+        size_t hi = n;
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+            if (widths[mid] <= width) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
         }
+        t->truncated_n = lo;
     }
 
-    t->truncated_n = i;
     t->target_width = width;
 }
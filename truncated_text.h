@@ -3,12 +3,27 @@
 #include <wchar.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <stdbool.h>
 
 typedef struct {
     wchar_t *s;
     size_t n;
+
+    // Cumulative widths: 'widths[i]' is the width of the first (i + 1) characters. NULL if every
+    // character has width 1. Filled by 'truncated_text_prepare()'.
+    uint32_t *widths;
+
     size_t truncated_n;
     uint32_t target_width;
 } TruncatedText;
 
+// Replaces non-printable characters with '.' and stores the cumulative widths into 'widths', which
+// must have room for 't->n' elements. Returns true if every character has width 1, in which case
+// the contents of 'widths' are not needed. Does not set 't->widths'.
+bool truncated_text_prepare(TruncatedText *t, uint32_t *widths);
+
+// Returns the width of the text as it is drawn once prepared; the text itself is not changed.
+uint32_t text_width(const wchar_t *s, size_t n);
+
+// Requires the text to have been prepared; this is a binary search over 't->widths'.
 void truncate_text_to_width(TruncatedText *t, uint32_t width);
@@ -0,0 +1,168 @@
+#include "utf8.h"
+#include "common.h"
+#include <stdint.h>
+#include <string.h>
+#include <langinfo.h>
+
+#if defined(__SSE2__)
+#   include <emmintrin.h>
+#endif
+
+#include "width_table.h"
+
+bool utf8_enabled = false;
+
+void utf8_init(void)
+{
+    utf8_enabled = WCHAR_MAX >= 0x7FFFFFFF && strcmp(nl_langinfo(CODESET), "UTF-8") == 0;
+}
+
+// Widens a run of ASCII bytes starting at 's' into 'out' for as long as the bytes are ASCII and not
+// zero. Returns the number of bytes widened.
+static size_t widen_ascii(const unsigned char *s, size_t ns, wchar_t *out)
+{
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    for (; ns - i >= 16; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (s + i));
+        // Bytes with the high bit set, or zero bytes.
+        if (_mm_movemask_epi8(_mm_or_si128(v, _mm_cmpeq_epi8(v, zero))))
+            break;
+        if (sizeof(wchar_t) == 4) {
+            __m128i lo = _mm_unpacklo_epi8(v, zero);
+            __m128i hi = _mm_unpackhi_epi8(v, zero);
+            _mm_storeu_si128((__m128i *) (out + i), _mm_unpacklo_epi16(lo, zero));
+            _mm_storeu_si128((__m128i *) (out + i + 4), _mm_unpackhi_epi16(lo, zero));
+            _mm_storeu_si128((__m128i *) (out + i + 8), _mm_unpacklo_epi16(hi, zero));
+            _mm_storeu_si128((__m128i *) (out + i + 12), _mm_unpackhi_epi16(hi, zero));
+        } else {
+            for (size_t j = 0; j < 16; ++j)
+                out[i + j] = s[i + j];
+        }
+    }
+#else
+    for (; ns - i >= 8; i += 8) {
+        uint64_t v;
+        memcpy(&v, s + i, 8);
+        // High bits, or zero bytes (the classic "has zero byte" trick).
+        uint64_t zero = (v - UINT64_C(0x0101010101010101)) & ~v;
+        if ((v | zero) & UINT64_C(0x8080808080808080))
+            break;
+        for (size_t j = 0; j < 8; ++j)
+            out[i + j] = s[i + j];
+    }
+#endif
+    for (; i < ns; ++i) {
+        unsigned char c = s[i];
+        if (c == 0 || c >= 0x80)
+            break;
+        out[i] = c;
+    }
+    return i;
+}
+
+// Decodes one non-ASCII sequence. Returns its length, or 0 if it is invalid or incomplete.
+//
+// Like glibc, this accepts the original (up to 6 bytes, up to 0x7FFFFFFF) form of UTF-8, so that
+// the results match mbsnrtowcs(); code points past 0x10FFFF are then shown as non-printable.
+static size_t decode_seq(const unsigned char *s, size_t ns, uint32_t *out)
+{
+    static const uint32_t mins[7] = {0, 0, 0x80, 0x800, 0x10000, 0x200000, 0x4000000};
+
+    unsigned char c = s[0];
+    size_t len;
+    if (c >= 0xC2 && c <= 0xDF) {
+        len = 2;
+    } else if (c >= 0xE0 && c <= 0xEF) {
+        len = 3;
+    } else if (c >= 0xF0 && c <= 0xF7) {
+        len = 4;
+    } else if (c >= 0xF8 && c <= 0xFB) {
+        len = 5;
+    } else if (c >= 0xFC && c <= 0xFD) {
+        len = 6;
+    } else {
+        return 0;
+    }
+    if (ns < len)
+        return 0;
+    uint32_t cp = c & (0x7F >> len);
+    for (size_t i = 1; i < len; ++i) {
+        if ((s[i] & 0xC0) != 0x80)
+            return 0;
+        cp = (cp << 6) | (s[i] & 0x3F);
+    }
+    if (cp < mins[len] || (cp >= 0xD800 && cp <= 0xDFFF))
+        return 0;
+    *out = cp;
+    return len;
+}
+
+ssize_t utf8_decode_append(const char *s, size_t ns, wchar_t **pbuf, size_t *pnbuf, size_t off)
+{
+    const unsigned char *u = (const unsigned char *) s;
+
+    // A UTF-8 string never decodes to more wide characters than it has bytes.
+    while (*pnbuf - off < ns + 1) {
+        *pbuf = x2realloc_or_die(*pbuf, pnbuf, sizeof(wchar_t));
+    }
+    wchar_t *out = *pbuf + off;
+
+    size_t i = 0;
+    size_t n = 0;
+    while (i < ns) {
+        size_t nascii = widen_ascii(u + i, ns - i, out + n);
+        i += nascii;
+        n += nascii;
+        if (i == ns || u[i] == 0)
+            break;
+
+        uint32_t cp;
+        size_t len = decode_seq(u + i, ns - i, &cp);
+        if (!len)
+            return -1;
+        out[n++] = cp;
+        i += len;
+    }
+    out[n] = L'\0';
+    return n;
+}
+
+ssize_t utf8_text_width(const char *s, size_t ns)
+{
+    const unsigned char *u = (const unsigned char *) s;
+    size_t w = 0;
+    size_t i = 0;
+    while (i < ns) {
+        unsigned char c = u[i];
+        if (c < 0x80) {
+            if (c == 0)
+                break;
+            // Non-printable characters are drawn as '.'.
+            ++w;
+            ++i;
+            continue;
+        }
+        uint32_t cp;
+        size_t len = decode_seq(u + i, ns - i, &cp);
+        if (!len)
+            return -1;
+        int cw = utf8_wcwidth(cp);
+        w += cw < 0 ? 1 : cw;
+        i += len;
+    }
+    return w;
+}
+
+int utf8_wcwidth(wchar_t c)
+{
+    if (!utf8_enabled)
+        return wcwidth(c);
+    uint32_t cp = c;
+    if (cp >= 0x110000)
+        return -1;
+    unsigned packed = width_stage2[width_stage1[cp / WIDTH_TABLE_BLOCK]][(cp % WIDTH_TABLE_BLOCK) / 4];
+    unsigned w = (packed >> (2 * (cp % 4))) & 3;
+    return w == 3 ? -1 : (int) w;
+}
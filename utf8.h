@@ -0,0 +1,24 @@
+#pragma once
+
+#include <wchar.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+// Self-contained UTF-8 decoding and character widths, used instead of mbsnrtowcs() and wcwidth()
+// when the current locale's encoding is UTF-8 and 'wchar_t' is 32-bit.
+
+extern bool utf8_enabled;
+
+// Must be called after setlocale().
+void utf8_init(void);
+
+// Same contract as 'decode_append()'; requires 'utf8_enabled'.
+ssize_t utf8_decode_append(const char *s, size_t ns, wchar_t **pbuf, size_t *pnbuf, size_t off);
+
+// Same as wcwidth(), but table-driven if 'utf8_enabled'.
+int utf8_wcwidth(wchar_t c);
+
+// Returns what 'text_width()' returns for the decoded text (see "truncated_text.h"), straight from the
+// bytes; or -1 on encoding error, as for 'utf8_decode_append()'. Requires 'utf8_enabled'.
+ssize_t utf8_text_width(const char *s, size_t ns);
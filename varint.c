@@ -0,0 +1,34 @@
+#include "varint.h"
+
+size_t varint_encode(char *out, uint64_t x)
+{
+    size_t n = 0;
+    while (x >= 0x80) {
+        out[n++] = (char) ((x & 0x7F) | 0x80);
+        x >>= 7;
+    }
+    out[n++] = (char) x;
+    return n;
+}
+
+int varint_decode(const char *s, size_t ns, uint64_t *out)
+{
+    uint64_t r = 0;
+    for (size_t i = 0; i < ns; ++i) {
+        if (i == VARINT_MAX) {
+            return -1;
+        }
+        unsigned char c = s[i];
+        uint64_t group = c & 0x7F;
+        unsigned shift = 7 * i;
+        if (shift == 63 && group > 1) {
+            return -1;
+        }
+        r |= group << shift;
+        if (!(c & 0x80)) {
+            *out = r;
+            return i + 1;
+        }
+    }
+    return 0;
+}
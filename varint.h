@@ -0,0 +1,16 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Unsigned LEB128: 7 bits per byte, least significant group first, high bit set on all bytes but
+// the last one.
+
+enum { VARINT_MAX = 10 };
+
+// Writes at most VARINT_MAX bytes.
+size_t varint_encode(char *out, uint64_t x);
+
+// Returns the number of bytes consumed, 0 if 's' ends in the middle of the varint, or -1 if the
+// value does not fit into uint64_t.
+int varint_decode(const char *s, size_t ns, uint64_t *out);
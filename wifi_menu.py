@@ -164,32 +164,28 @@ def launch_cmenu(args):
         )
 
 
+# The entries of the cmenu list are keyed by network path (see '-keyed'), so there is no need to keep
+# track of their indices.
 class NetworkList:
     def __init__(self):
-        self._nets = []
-        self._idx_by_path = {}
+        self._nets_by_path = {}
 
     def add_get_delta(self, new_nets):
         new_paths = frozenset(net.path for net in new_nets)
         delta = []
 
-        for idx, net in enumerate(self._nets):
-            if net.path not in new_paths:
-                delta.append(('=', idx, net, False))
+        for path, net in self._nets_by_path.items():
+            if path not in new_paths:
+                delta.append((net, False))
 
         for net in new_nets:
-            idx = self._idx_by_path.get(net.path)
-            if idx is not None:
-                delta.append(('=', idx, net, True))
-            else:
-                self._idx_by_path[net.path] = len(self._nets)
-                self._nets.append(net)
-                delta.append(('+', None, net, True))
+            self._nets_by_path[net.path] = net
+            delta.append((net, True))
 
         return delta
 
-    def get_by_index(self, idx):
-        return self._nets[idx]
+    def get_by_path(self, path):
+        return self._nets_by_path[path]
 
 
 def escape_str(s):
@@ -253,6 +249,7 @@ def device_list_dialog(devices):
 
 def network_list_dialog(conn, device):
     child, in_f, out_f = launch_cmenu([
+        '-keyed',
         '-command=r',
         '-command=d',
         '-column=@7:Status',
@@ -268,11 +265,8 @@ def network_list_dialog(conn, device):
             delta = network_list.add_get_delta(new_nets)
             try:
                 out_f.write(f'n {len(delta)}\n')
-                for command, index, net, is_available in delta:
-                    if index is not None:
-                        out_f.write(f'{command} {index}\n')
-                    else:
-                        out_f.write(f'{command}\n')
+                for net, is_available in delta:
+                    out_f.write(f'k {net.path}\n')
                     for column in net_to_columns(net, is_available):
                         out_f.write(column)
                         out_f.write('\n')
@@ -291,9 +285,9 @@ def network_list_dialog(conn, device):
         if line == '':
             return None, 'q'
         if line == 'result\n':
-            line = in_f.readline()
-            index = int(line.rstrip('\n'))
-            return network_list.get_by_index(index), None
+            in_f.readline()  # the index
+            path = in_f.readline().rstrip('\n')
+            return network_list.get_by_path(path), None
         if line == 'custom\n':
             line = in_f.readline()
             return None, line.rstrip('\n')